@@ -94,6 +94,8 @@ void VoxelReconstruction::showKeys()
 	cout << "c       : Show/hide cameras" << endl;
 	cout << "i       : Show/hide camera numbers (Linux only)" << endl;
 	cout << "o       : Show/hide origin" << endl;
+	cout << "m       : Show mesh/voxels" << endl;
+	cout << "e       : Export mesh (PLY and OBJ)" << endl;
 	cout << "t       : Top view" << endl;
 	cout << "1,2,3,4 : Switch camera #" << endl << endl;
 	cout << "Zoom with the scrollwheel while on the 3D scene" << endl;
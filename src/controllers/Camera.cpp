@@ -18,10 +18,18 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgproc/types_c.h>
 #include <stddef.h>
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE2
+#endif
+
 #include "../utilities/General.h"
 
 using namespace std;
@@ -44,6 +52,14 @@ Camera::Camera(
 	m_fy = 0;
 	m_cx = 0;
 	m_cy = 0;
+	m_k1 = 0;
+	m_k2 = 0;
+	m_k3 = 0;
+	m_p1 = 0;
+	m_p2 = 0;
+	m_batch_projection = false;
+	m_monotonic_radius = 0;
+	m_foreground_area = 0;
 	m_frame_amount = 0;
 }
 
@@ -133,6 +149,7 @@ bool Camera::initialize()
 	}
 
 	initCamLoc();
+	initProjection();
 	camPtInWorld();
 
 	return m_initialized;
@@ -167,6 +184,130 @@ Mat& Camera::getVideoFrame(
 	return advanceVideoFrame();
 }
 
+/**
+ * Pack the foreground image (white is foreground) to one bit per pixel
+ */
+void Camera::packForeground()
+{
+	assert(m_foreground_image.type() == CV_8U && m_foreground_image.isContinuous());
+
+	const int pixels = (int) m_foreground_image.total();
+	const uchar* image = m_foreground_image.ptr<uchar>();
+	m_foreground_bits.assign((pixels + 63) / 64, 0);
+
+	int p = 0;
+#ifdef USE_SSE2
+	const __m128i white = _mm_set1_epi8((char) 255);
+	for (; p + 64 <= pixels; p += 64)
+	{
+		uint64_t word = 0;
+		for (int b = 0; b < 64; b += 16)
+		{
+			const __m128i bytes = _mm_loadu_si128((const __m128i*) (image + p + b));
+			word |= (uint64_t) (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, white)) << b;
+		}
+		m_foreground_bits[p >> 6] = word;
+	}
+#endif
+
+	for (; p < pixels; ++p)
+		if (image[p] == 255) m_foreground_bits[p >> 6] |= (uint64_t) 1 << (p & 63);
+}
+
+/**
+ * Build the max-pooled foreground pyramid: a pixel on level l is white if any
+ * pixel of the 2x2 pixels below it on level l-1 is white
+ */
+void Camera::buildForegroundPyramid()
+{
+	m_foreground_pyramid.resize(PYRAMID_LEVELS);
+	m_foreground_pyramid[0] = m_foreground_image;
+
+	for (int l = 1; l < PYRAMID_LEVELS; ++l)
+	{
+		const Mat &below = m_foreground_pyramid[l - 1];
+		Mat &level = m_foreground_pyramid[l];
+		level.create((below.rows + 1) / 2, (below.cols + 1) / 2, CV_8U);
+
+		for (int y = 0; y < level.rows; ++y)
+		{
+			const uchar* row0 = below.ptr<uchar>(2 * y);
+			const uchar* row1 = below.ptr<uchar>(std::min(2 * y + 1, below.rows - 1));
+			uchar* row = level.ptr<uchar>(y);
+
+			for (int x = 0; x < level.cols; ++x)
+			{
+				const int x0 = 2 * x;
+				const int x1 = std::min(x0 + 1, below.cols - 1);
+				row[x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+			}
+		}
+	}
+}
+
+/**
+ * Find the bounding box of the foreground pixels (empty if there are none) and count them
+ */
+void Camera::boundForeground()
+{
+	m_foreground_box = boundingRect(m_foreground_image);
+
+	m_foreground_area = 0;
+	for (size_t w = 0; w < m_foreground_bits.size(); ++w)
+		m_foreground_area += General::bitCount(m_foreground_bits[w]);
+}
+
+/**
+ * Count the foreground pixels in the rectangle (clipped to the image)
+ */
+int Camera::countForeground(
+		const Rect &rect) const
+{
+	const Rect clipped = rect & Rect(0, 0, m_plane_size.width, m_plane_size.height);
+	if (clipped.area() <= 0) return 0;
+
+	int count = 0;
+	for (int y = clipped.y; y < clipped.y + clipped.height; ++y)
+	{
+		// Bits [first, last] of the packed foreground hold the row's pixels in the rectangle
+		const size_t first = (size_t) y * m_plane_size.width + clipped.x;
+		const size_t last = first + clipped.width - 1;
+		for (size_t w = first / 64; w <= last / 64; ++w)
+		{
+			uint64_t word = m_foreground_bits[w];
+			if (w == first / 64) word &= ~(uint64_t) 0 << (first % 64);
+			if (w == last / 64) word &= ~(uint64_t) 0 >> (63 - last % 64);
+			count += General::bitCount(word);
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Check if there's any foreground in the pixel rectangle [x0, x1] x [y0, y1]
+ * The test runs on the finest pyramid level where the rectangle spans at most
+ * 4x4 cells, so it may report foreground just outside the rectangle but never
+ * misses foreground inside it
+ */
+bool Camera::hasForeground(
+		int x0, int y0, int x1, int y1) const
+{
+	int l = 0;
+	while (l + 1 < (int) m_foreground_pyramid.size() && ((x1 >> l) - (x0 >> l) >= 4 || (y1 >> l) - (y0 >> l) >= 4))
+		++l;
+
+	const Mat &level = m_foreground_pyramid[l];
+	for (int y = y0 >> l; y <= (y1 >> l); ++y)
+	{
+		const uchar* row = level.ptr<uchar>(y);
+		for (int x = x0 >> l; x <= (x1 >> l); ++x)
+			if (row[x]) return true;
+	}
+
+	return false;
+}
+
 /**
  * Handle mouse events
  */
@@ -453,6 +594,49 @@ void Camera::initCamLoc()
 	invert(m_rt, m_inverse_rt);
 }
 
+/**
+ * Cache the rotation matrix, translation and distortion model as plain floats
+ * for the batch projection kernel
+ */
+void Camera::initProjection()
+{
+	Mat r;
+	Rodrigues(m_rotation_values, r);
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			m_r[i * 3 + j] = r.at<float>(i, j);
+		m_t[i] = m_translation_values.at<float>(i, 0);
+	}
+
+	// [k1 k2 p1 p2 k3], OpenCV's higher order (rational, prism, tilt) terms aren't supported
+	const int coeffs = (int) m_distortion_coeffs.total();
+	const float* d = m_distortion_coeffs.ptr<float>();
+	m_k1 = coeffs > 0 ? d[0] : 0;
+	m_k2 = coeffs > 1 ? d[1] : 0;
+	m_p1 = coeffs > 2 ? d[2] : 0;
+	m_p2 = coeffs > 3 ? d[3] : 0;
+	m_k3 = coeffs > 4 ? d[4] : 0;
+	m_batch_projection = coeffs <= 5;
+
+	// Beyond the radius where r * (1 + k1 r^2 + k2 r^4 + k3 r^6) turns, points far outside the FoV fold back into the image
+	m_monotonic_radius = 0;
+	while (m_monotonic_radius < 10)
+	{
+		const float r2 = m_monotonic_radius * m_monotonic_radius;
+		if (1 + r2 * (3 * m_k1 + r2 * (5 * m_k2 + r2 * 7 * m_k3)) <= 0) break;
+		m_monotonic_radius += 0.01f;
+	}
+
+	// The batch projection must agree with projectPoints, check a sample in front of the camera
+	vector<Point3f> sample;
+	for (int y = -2048; y <= 2048; y += 512)
+		for (int x = -2048; x <= 2048; x += 512)
+			for (int z = 0; z <= 2048; z += 512)
+				sample.push_back(Point3f((float) x, (float) y, (float) z));
+	assert(projectionError(sample) < 1e-2);
+}
+
 /**
  * Calculate the camera's plane and fov in the 3D scene
  */
@@ -480,6 +664,78 @@ void Camera::camPtInWorld()
 	m_camera_plane.push_back(p5);
 }
 
+/**
+ * Whether the image region covering the given world points can be back projected:
+ * all points are in front of the camera and well within the radius where the lens
+ * distortion is monotonic
+ * The perspective projection of their convex hull is the convex hull of their
+ * projections, so checking the corners of a box covers the whole box.
+ */
+bool Camera::canBackProject(
+		const vector<Point3f> &points) const
+{
+	for (size_t i = 0; i < points.size(); ++i)
+	{
+		const Point3f &p = points[i];
+		const float x = m_r[0] * p.x + m_r[1] * p.y + m_r[2] * p.z + m_t[0];
+		const float y = m_r[3] * p.x + m_r[4] * p.y + m_r[5] * p.z + m_t[1];
+		const float z = m_r[6] * p.x + m_r[7] * p.y + m_r[8] * p.z + m_t[2];
+		if (z <= 0 || sqrt(x * x + y * y) >= 0.9f * m_monotonic_radius * z) return false;
+	}
+
+	return m_batch_projection;
+}
+
+/**
+ * Back project an image rectangle into the world, as the 4 planes (a, b, c, d) of
+ * the pyramid of rays through it: a point (x, y, z) in front of the camera projects
+ * in the rectangle if a * x + b * y + c * z + d >= 0 for all 4 planes
+ * The rectangle's border is undistorted to normalized image coordinates (like
+ * ptToW3D's rays, but through the lens distortion) and bounded, so the pyramid
+ * contains the rectangle's curved undistorted image.
+ */
+void Camera::backProjectRect(
+		const Rect &rect, vector<Vec4f> &planes) const
+{
+	const int border_step = 16;
+
+	vector<Point2f> border;
+	for (int x = rect.x; x < rect.x + rect.width; x += border_step)
+	{
+		border.push_back(Point2f((float) x, (float) rect.y));
+		border.push_back(Point2f((float) x, (float) (rect.y + rect.height)));
+	}
+	for (int y = rect.y; y < rect.y + rect.height; y += border_step)
+	{
+		border.push_back(Point2f((float) rect.x, (float) y));
+		border.push_back(Point2f((float) (rect.x + rect.width), (float) y));
+	}
+	border.push_back(Point2f((float) (rect.x + rect.width), (float) (rect.y + rect.height)));
+
+	vector<Point2f> normalized;
+	undistortPoints(border, normalized, m_camera_matrix, m_distortion_coeffs);
+
+	float u0 = FLT_MAX, u1 = -FLT_MAX, v0 = FLT_MAX, v1 = -FLT_MAX;
+	for (size_t i = 0; i < normalized.size(); ++i)
+	{
+		u0 = std::min(u0, normalized[i].x);
+		u1 = std::max(u1, normalized[i].x);
+		v0 = std::min(v0, normalized[i].y);
+		v1 = std::max(v1, normalized[i].y);
+	}
+
+	// In camera coordinates: x - u0 * z >= 0, u1 * z - x >= 0, y - v0 * z >= 0, v1 * z - y >= 0
+	const float bounds[4][3] = { { 1, 0, -u0 }, { -1, 0, u1 }, { 0, 1, -v0 }, { 0, -1, v1 } };
+	for (int b = 0; b < 4; ++b)
+	{
+		Vec4f plane;
+		for (int j = 0; j < 3; ++j)
+			plane[j] = bounds[b][0] * m_r[j] + bounds[b][1] * m_r[3 + j] + bounds[b][2] * m_r[6 + j];
+		plane[3] = bounds[b][0] * m_t[0] + bounds[b][1] * m_t[1] + bounds[b][2] * m_t[2];
+		planes.push_back(plane);
+	}
+}
+
 /**
  * Convert a point on the camera image to a point in the world
  */
@@ -531,4 +787,182 @@ Point Camera::projectOnView(
 	return projectOnView(coords, m_rotation_values, m_translation_values, m_camera_matrix, m_distortion_coeffs);
 }
 
+/**
+ * Projects points from the camera space (X, Y, Z) to the image coordinates (u, v)
+ * using the pinhole model with k1, k2, k3 radial and p1, p2 tangential distortion,
+ * in the same way as projectPoints does. Four points at a time with SSE2.
+ */
+void Camera::projectCamPoints(
+		const float* X, const float* Y, const float* Z, int n, float* u, float* v) const
+{
+	int i = 0;
+
+#ifdef USE_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 two = _mm_set1_ps(2.f);
+	const __m128 k1 = _mm_set1_ps(m_k1), k2 = _mm_set1_ps(m_k2), k3 = _mm_set1_ps(m_k3);
+	const __m128 p1 = _mm_set1_ps(m_p1), p2 = _mm_set1_ps(m_p2);
+	const __m128 fx = _mm_set1_ps(m_fx), fy = _mm_set1_ps(m_fy);
+	const __m128 cx = _mm_set1_ps(m_cx), cy = _mm_set1_ps(m_cy);
+
+	for (; i + 4 <= n; i += 4)
+	{
+		// Perspective division, a point on the camera plane (Z == 0) is divided by 1
+		const __m128 z = _mm_loadu_ps(Z + i);
+		const __m128 on_plane = _mm_cmpeq_ps(z, zero);
+		const __m128 iz = _mm_or_ps(_mm_andnot_ps(on_plane, _mm_div_ps(one, z)), _mm_and_ps(on_plane, one));
+		const __m128 x = _mm_mul_ps(_mm_loadu_ps(X + i), iz);
+		const __m128 y = _mm_mul_ps(_mm_loadu_ps(Y + i), iz);
+
+		const __m128 x2 = _mm_mul_ps(x, x);
+		const __m128 y2 = _mm_mul_ps(y, y);
+		const __m128 xy2 = _mm_mul_ps(two, _mm_mul_ps(x, y));
+		const __m128 r2 = _mm_add_ps(x2, y2);
+
+		// 1 + k1 * r^2 + k2 * r^4 + k3 * r^6
+		const __m128 radial = _mm_add_ps(one,
+				_mm_mul_ps(r2, _mm_add_ps(k1, _mm_mul_ps(r2, _mm_add_ps(k2, _mm_mul_ps(r2, k3))))));
+
+		const __m128 xd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, radial), _mm_mul_ps(p1, xy2)),
+				_mm_mul_ps(p2, _mm_add_ps(r2, _mm_mul_ps(two, x2))));
+		const __m128 yd = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, radial), _mm_mul_ps(p1, _mm_add_ps(r2, _mm_mul_ps(two, y2)))),
+				_mm_mul_ps(p2, xy2));
+
+		_mm_storeu_ps(u + i, _mm_add_ps(_mm_mul_ps(xd, fx), cx));
+		_mm_storeu_ps(v + i, _mm_add_ps(_mm_mul_ps(yd, fy), cy));
+	}
+#endif
+
+	for (; i < n; ++i)
+	{
+		const float iz = Z[i] != 0 ? 1.f / Z[i] : 1.f;
+		const float x = X[i] * iz;
+		const float y = Y[i] * iz;
+
+		const float x2 = x * x;
+		const float y2 = y * y;
+		const float xy2 = 2 * x * y;
+		const float r2 = x2 + y2;
+		const float radial = 1 + r2 * (m_k1 + r2 * (m_k2 + r2 * m_k3));
+
+		const float xd = x * radial + m_p1 * xy2 + m_p2 * (r2 + 2 * x2);
+		const float yd = y * radial + m_p1 * (r2 + 2 * y2) + m_p2 * xy2;
+
+		u[i] = xd * m_fx + m_cx;
+		v[i] = yd * m_fy + m_cy;
+	}
+}
+
+/**
+ * Projects a batch of points from the scene space to the image coordinates
+ */
+void Camera::projectOnView(
+		const vector<Point3f> &coords, vector<Point2f> &image_points) const
+{
+	if (!m_batch_projection)
+	{
+		if (coords.empty())
+			image_points.clear();
+		else
+			projectPoints(coords, m_rotation_values, m_translation_values, m_camera_matrix, m_distortion_coeffs, image_points);
+		return;
+	}
+
+	const int n = (int) coords.size();
+	vector<float> X(n), Y(n), Z(n), u(n), v(n);
+	for (int i = 0; i < n; ++i)
+	{
+		const Point3f &p = coords[i];
+		X[i] = m_r[0] * p.x + m_r[1] * p.y + m_r[2] * p.z + m_t[0];
+		Y[i] = m_r[3] * p.x + m_r[4] * p.y + m_r[5] * p.z + m_t[1];
+		Z[i] = m_r[6] * p.x + m_r[7] * p.y + m_r[8] * p.z + m_t[2];
+	}
+
+	projectCamPoints(X.data(), Y.data(), Z.data(), n, u.data(), v.data());
+
+	image_points.resize(n);
+	for (int i = 0; i < n; ++i)
+		image_points[i] = Point2f(u[i], v[i]);
+}
+
+/**
+ * Projects a grid of points from the scene space to the image pixels
+ * The grid lies in the plane z = origin.z and holds size.width points along the
+ * x axis by size.height points along the y axis, step apart. The pixels are
+ * stored row by row (x varies fastest).
+ */
+void Camera::projectOnViewGrid(
+		const Point3f &origin, int step, const Size &size, vector<Point> &points) const
+{
+	points.resize(size.area());
+
+	if (!m_batch_projection)
+	{
+		vector<Point3f> coords;
+		coords.reserve(size.area());
+		for (int y = 0; y < size.height; ++y)
+			for (int x = 0; x < size.width; ++x)
+				coords.push_back(Point3f(origin.x + x * step, origin.y + y * step, origin.z));
+
+		vector<Point2f> image_points;
+		projectOnView(coords, image_points);
+		for (size_t p = 0; p < image_points.size(); ++p)
+			points[p] = Point(cvRound(image_points[p].x), cvRound(image_points[p].y));
+		return;
+	}
+
+	// Along a row the camera space coordinates are linear in x
+	const float dX = m_r[0] * step;
+	const float dY = m_r[3] * step;
+	const float dZ = m_r[6] * step;
+
+	const int w = size.width;
+	vector<float> X(w), Y(w), Z(w), u(w), v(w);
+	for (int y = 0; y < size.height; ++y)
+	{
+		const float wy = origin.y + y * step;
+		const float X0 = m_r[0] * origin.x + m_r[1] * wy + m_r[2] * origin.z + m_t[0];
+		const float Y0 = m_r[3] * origin.x + m_r[4] * wy + m_r[5] * origin.z + m_t[1];
+		const float Z0 = m_r[6] * origin.x + m_r[7] * wy + m_r[8] * origin.z + m_t[2];
+
+		for (int x = 0; x < w; ++x)
+		{
+			X[x] = X0 + x * dX;
+			Y[x] = Y0 + x * dY;
+			Z[x] = Z0 + x * dZ;
+		}
+
+		projectCamPoints(X.data(), Y.data(), Z.data(), w, u.data(), v.data());
+
+		Point* row = &points[y * w];
+		for (int x = 0; x < w; ++x)
+			row[x] = Point(cvRound(u[x]), cvRound(v[x]));
+	}
+}
+
+/**
+ * Largest distance (in pixels) between the batch projection of the given points
+ * and the projection by projectPoints, for the points that land on the image
+ */
+double Camera::projectionError(
+		const vector<Point3f> &coords) const
+{
+	if (coords.empty()) return 0;
+
+	vector<Point2f> batch_points, cv_points;
+	projectOnView(coords, batch_points);
+	projectPoints(coords, m_rotation_values, m_translation_values, m_camera_matrix, m_distortion_coeffs, cv_points);
+
+	double error = 0;
+	for (size_t p = 0; p < coords.size(); ++p)
+	{
+		const Point2f &cv_point = cv_points[p];
+		if (cv_point.x >= 0 && cv_point.x < m_plane_size.width && cv_point.y >= 0 && cv_point.y < m_plane_size.height)
+			error = std::max(error, (double) norm(batch_points[p] - cv_point));
+	}
+
+	return error;
+}
+
 } /* namespace nl_uu_science_gmt */
@@ -11,6 +11,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/mat.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -18,6 +19,7 @@ namespace nl_uu_science_gmt
 {
 
 #define MAIN_WINDOW "Checkerboard Marking"
+#define PYRAMID_LEVELS 7  // Foreground pyramid levels, the coarsest one has 64x64 pixel cells
 
 class Camera
 {
@@ -31,6 +33,10 @@ class Camera
 
 	std::vector<cv::Mat> m_bg_hsv_channels;          // Background HSV channel images
 	cv::Mat m_foreground_image;                      // This camera's foreground image (binary)
+	std::vector<uint64_t> m_foreground_bits;         // Foreground image packed to 1 bit per pixel
+	std::vector<cv::Mat> m_foreground_pyramid;       // Max-pooled foreground, level l pixels cover 2^l x 2^l pixels
+	cv::Rect m_foreground_box;                       // Bounding box of the foreground pixels
+	int m_foreground_area;                           // Amount of foreground pixels
 
 	cv::VideoCapture m_video;                        // Video reader
 
@@ -43,6 +49,11 @@ class Camera
 	cv::Mat m_translation_values;                    // Translation vector (3x1)
 
 	float m_fx, m_fy, m_cx, m_cy;                   // Focal lenghth (fx, fy), camera center (cx, cy)
+	float m_k1, m_k2, m_k3, m_p1, m_p2;             // Radial (k1, k2, k3) and tangential (p1, p2) distortion
+	float m_r[9];                                    // Rotation matrix (3x3, row major)
+	float m_t[3];                                    // Translation vector
+	bool m_batch_projection;                         // Is the distortion model supported by the batch projection
+	float m_monotonic_radius;                        // Normalized image radius up to which the radial distortion is monotonic
 
 	cv::Mat m_rt;                                    // R matrix
 	cv::Mat m_inverse_rt;                            // R's inverse matrix
@@ -55,7 +66,13 @@ class Camera
 
 	static void onMouse(int, int, int, int, void*);
 	void initCamLoc();
+	void initProjection();
 	inline void camPtInWorld();
+	void packForeground();
+	void buildForegroundPyramid();
+	void boundForeground();
+
+	void projectCamPoints(const float*, const float*, const float*, int, float*, float*) const;
 
 	cv::Point3f ptToW3D(const cv::Point &);
 	cv::Point3f cam3DtoW3D(const cv::Point3f &);
@@ -74,6 +91,9 @@ public:
 
 	static cv::Point projectOnView(const cv::Point3f &, const cv::Mat &, const cv::Mat &, const cv::Mat &, const cv::Mat &);
 	cv::Point projectOnView(const cv::Point3f &);
+	void projectOnView(const std::vector<cv::Point3f> &, std::vector<cv::Point2f> &) const;
+	void projectOnViewGrid(const cv::Point3f &, int, const cv::Size &, std::vector<cv::Point> &) const;
+	double projectionError(const std::vector<cv::Point3f> &) const;
 
 	const std::string& getCamPropertiesFile() const
 	{
@@ -128,6 +148,45 @@ public:
 	void setForegroundImage(const cv::Mat& foregroundImage)
 	{
 		m_foreground_image = foregroundImage;
+		packForeground();
+		buildForegroundPyramid();
+		boundForeground();
+	}
+
+	/*
+	 * The foreground image with one bit per pixel, the linear pixel offset p
+	 * (y * width + x) is bit (p % 64) of word (p / 64)
+	 */
+	const std::vector<uint64_t>& getForegroundBits() const
+	{
+		return m_foreground_bits;
+	}
+
+	static bool isForeground(const uint64_t* bits, int pixel)
+	{
+		return (bits[pixel >> 6] >> (pixel & 63)) & 1;
+	}
+
+	bool hasForeground(int, int, int, int) const;
+
+	const cv::Rect& getForegroundBox() const
+	{
+		return m_foreground_box;
+	}
+
+	int getForegroundArea() const
+	{
+		return m_foreground_area;
+	}
+
+	int countForeground(const cv::Rect &) const;
+
+	bool canBackProject(const std::vector<cv::Point3f> &) const;
+	void backProjectRect(const cv::Rect &, std::vector<cv::Vec4f> &) const;
+
+	const std::vector<cv::Mat>& getForegroundPyramid() const
+	{
+		return m_foreground_pyramid;
 	}
 
 	const cv::Mat& getFrame() const
@@ -149,6 +208,26 @@ public:
 	{
 		return m_camera_plane;
 	}
+
+	const cv::Mat& getCameraMatrix() const
+	{
+		return m_camera_matrix;
+	}
+
+	const cv::Mat& getDistortionCoeffs() const
+	{
+		return m_distortion_coeffs;
+	}
+
+	const cv::Mat& getRotationValues() const
+	{
+		return m_rotation_values;
+	}
+
+	const cv::Mat& getTranslationValues() const
+	{
+		return m_translation_values;
+	}
 };
 
 } /* namespace nl_uu_science_gmt */
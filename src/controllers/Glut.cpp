@@ -329,6 +329,15 @@ void Glut::keyboard(
 			bool origin = scene3d.isShowOrg();
 			scene3d.setShowOrg(!origin);
 		}
+		else if (key == 'm' || key == 'M')
+		{
+			bool mesh = scene3d.isShowMesh();
+			scene3d.setShowMesh(!mesh);
+		}
+		else if (key == 'e' || key == 'E')
+		{
+			exportMesh();
+		}
 		else if (key == 't' || key == 'T')
 		{
 			scene3d.setTopView();
@@ -553,7 +562,10 @@ void Glut::display()
 	if (scene3d.isShowArcball())
 		drawArcball();
 
-	drawVoxels();
+	if (scene3d.isShowMesh())
+		drawMesh();
+	else
+		drawVoxels();
 
 	if (scene3d.isShowOrg())
 		drawWCoord();
@@ -755,16 +767,45 @@ void Glut::drawCamCoord()
 }
 
 /**
- * Draw the voxel bounding box
+ * Draw the voxel bounding box, or the regions of the voxel space if it has any
  */
 void Glut::drawVolume()
 {
-	vector<Point3f*> corners = m_Glut->getScene3d().getReconstructor().getCorners();
+	const Reconstructor &reconstructor = m_Glut->getScene3d().getReconstructor();
+	vector<Point3f*> corners = reconstructor.getCorners();
+	const vector<Reconstructor::Region> &regions = reconstructor.getRegions();
 
 	glLineWidth(1.0f);
 	glPushMatrix();
 	glBegin(GL_LINES);
 
+	if (!regions.empty())
+	{
+		// bottom, top and connection of every region
+		glColor4f(0.9f, 0.9f, 0.9f, 0.5f);
+		for (size_t r = 0; r < regions.size(); ++r)
+		{
+			const vector<Point2f> &floor = regions[r].floor;
+			const float z0 = (float) regions[r].z0, z1 = (float) regions[r].z1;
+			for (size_t i = 0; i < floor.size(); ++i)
+			{
+				const Point2f &p = floor[i], &q = floor[(i + 1) % floor.size()];
+				glVertex3f(p.x, p.y, z0);
+				glVertex3f(q.x, q.y, z0);
+
+				glVertex3f(p.x, p.y, z1);
+				glVertex3f(q.x, q.y, z1);
+
+				glVertex3f(p.x, p.y, z0);
+				glVertex3f(p.x, p.y, z1);
+			}
+		}
+
+		glEnd();
+		glPopMatrix();
+		return;
+	}
+
 	// VR->volumeCorners[0]; // what's this frank?
 	// bottom
 	glColor4f(0.9f, 0.9f, 0.9f, 0.5f);
@@ -841,7 +882,7 @@ void Glut::drawArcball()
 }
 
 /**
- * Draw all visible voxels
+ * Draw the visible voxels on the surface, in their colours if the reconstructor colours them
  */
 void Glut::drawVoxels()
 {
@@ -852,17 +893,77 @@ void Glut::drawVoxels()
 	glPointSize(2.0f);
 	glBegin(GL_POINTS);
 
-	vector<Reconstructor::Voxel*> voxels = m_Glut->getScene3d().getReconstructor().getVisibleVoxels();
+	// the voxels inside are hidden by the surface
+	Reconstructor& reconstructor = m_Glut->getScene3d().getReconstructor();
+	const vector<int>& voxels = reconstructor.getSurfaceVoxels();
+	const vector<Vec3b> no_colors;
+	const vector<Vec3b>& colors = reconstructor.isColoring() ? reconstructor.getVoxelColors() : no_colors;
 	for (size_t v = 0; v < voxels.size(); v++)
 	{
-		glColor4f(0.5f, 0.5f, 0.5f, 0.5f);
-		glVertex3f((GLfloat) voxels[v]->x, (GLfloat) voxels[v]->y, (GLfloat) voxels[v]->z);
+		const Reconstructor::Voxel voxel = reconstructor.getVoxel(voxels[v]);
+		if (colors.empty())
+			glColor4f(0.5f, 0.5f, 0.5f, 0.5f);
+		else
+			glColor4f(colors[v][2] / 255.0f, colors[v][1] / 255.0f, colors[v][0] / 255.0f, 1.0f);
+		glVertex3f((GLfloat) voxel.x, (GLfloat) voxel.y, (GLfloat) voxel.z);
 	}
 
 	glEnd();
 	glPopMatrix();
 }
 
+/**
+ * Draw the mesh of the visible voxels, each triangle shaded by how much it faces the
+ * viewer's default direction (from above)
+ */
+void Glut::drawMesh()
+{
+	glPushMatrix();
+	glBegin(GL_TRIANGLES);
+
+	const Mesh& mesh = m_Glut->getScene3d().getReconstructor().getMesh();
+	for (size_t t = 0; t < mesh.triangles.size(); t++)
+	{
+		const Point3f& a = mesh.vertices[mesh.triangles[t][0]];
+		const Point3f& b = mesh.vertices[mesh.triangles[t][1]];
+		const Point3f& c = mesh.vertices[mesh.triangles[t][2]];
+		const Point3f normal = (b - a).cross(c - a);
+		const float length = (float) norm(normal);
+		const float shade = 0.3f + 0.6f * (length > 0 ? std::abs(normal.z) / length : 0);
+
+		glColor4f(shade, shade, shade, 1.0f);
+		glVertex3f(a.x, a.y, a.z);
+		glVertex3f(b.x, b.y, b.z);
+		glVertex3f(c.x, c.y, c.z);
+	}
+
+	glEnd();
+	glPopMatrix();
+}
+
+/**
+ * Write the mesh of the current frame next to voxels.xml, as binary PLY and as OBJ
+ */
+void Glut::exportMesh()
+{
+	Scene3DRenderer& scene3d = m_Glut->getScene3d();
+	Reconstructor& reconstructor = scene3d.getReconstructor();
+	const Mesh& mesh = reconstructor.getMesh();
+
+	stringstream name;
+	name << scene3d.getCameras().front()->getDataPath() << ".." << PATH_SEP << General::MeshFile << scene3d.getCurrentFrame();
+	const int64 start = getTickCount();
+	if (!MarchingCubes::writePly(name.str() + ".ply", mesh) || !MarchingCubes::writeObj(name.str() + ".obj", mesh))
+	{
+		cerr << "Unable to write mesh: " << name.str() << endl;
+		return;
+	}
+
+	cout << "Mesh " << name.str() << ": " << mesh.vertices.size() << " vertices, " << mesh.triangles.size()
+			<< " triangles, extracted in " << reconstructor.getMeshTime() << "ms, written in "
+			<< (getTickCount() - start) * 1000.0 / getTickFrequency() << "ms" << endl;
+}
+
 /**
  * Draw origin into scene
  */
@@ -38,6 +38,8 @@ class Glut
 	static void drawVolume();
 	static void drawArcball();
 	static void drawVoxels();
+	static void drawMesh();
+	static void exportMesh();
 	static void drawWCoord();
 	static void drawInfo();
 
@@ -10,26 +10,286 @@
 #include <opencv2/core/mat.hpp>
 #include <opencv2/core/operations.hpp>
 #include <opencv2/core/types_c.h>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <utility>
 
 #include "../utilities/General.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define USE_AVX2
+#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_M_X64)
+#include <immintrin.h>
+#define USE_AVX2
+#define AVX2_TARGET
+#endif
+
 using namespace std;
 using namespace cv;
 
 namespace nl_uu_science_gmt
 {
 
+const int Reconstructor::INVALID_PIXEL;
+const int Reconstructor::CHUNK_WORDS;
+const int Reconstructor::NODE_LEVELS;
+const int Reconstructor::SAMPLE_WORDS;
+const int Reconstructor::ROI_PADDING;
+const int Reconstructor::BRICK_SIZE;
+const int Reconstructor::DEPTH_CELL;
+const int Reconstructor::MAX_REFINE_LEVELS;
+const int Reconstructor::REFINE_CHUNK;
+const int Reconstructor::LABEL_BLOCK_PLANES;
+const int Reconstructor::MAX_TRACK_ITERATIONS;
+
+namespace
+{
+
+const char LUT_MAGIC[8] = { 'V', 'O', 'X', 'E', 'L', 'L', 'U', 'T' };
+const uint32_t LUT_VERSION = 2;  // Bump whenever the LUT layout or its contents change
+
+/*
+ * Header of the LUT cache file, followed by the LUT itself, the voxels' grid indices and
+ * for footprint tests the footprints
+ */
+struct LutHeader
+{
+	char magic[8];                      // LUT_MAGIC
+	uint32_t version;                   // LUT_VERSION
+	uint32_t cameras;                   // Camera count
+	uint64_t key;                       // Hash of the calibration and volume parameters
+	uint64_t voxels;                    // Voxel count (after pruning)
+	int32_t bounds[6];                  // Volume bounds (after shrinking): xL, xR, yL, yR, zL, zR
+	char padding[8];                    // Align the LUT to a cache line
+};
+
+/**
+ * 64 bit FNV-1a hash
+ */
+uint64_t hashBytes(
+		uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*) data;
+	for (size_t i = 0; i < size; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+/**
+ * Read a value from the XML node, if it's there
+ */
+template<typename T>
+void readValue(
+		const FileNode &node, T &value)
+{
+	if (!node.empty()) node >> value;
+}
+
+uint64_t hashMat(
+		uint64_t hash, const Mat &mat)
+{
+	assert(mat.empty() || mat.isContinuous());
+	const int rows = mat.rows, cols = mat.cols;
+	hash = hashBytes(hash, &rows, sizeof(rows));
+	hash = hashBytes(hash, &cols, sizeof(cols));
+	return hashBytes(hash, mat.ptr(), mat.total() * mat.elemSize());
+}
+
+/**
+ * Spread the low 21 bits of value over every third bit, for Morton keys
+ */
+uint64_t spreadBits(
+		uint64_t value)
+{
+	value &= 0x1fffff;
+	value = (value | value << 32) & 0x1f00000000ffffULL;
+	value = (value | value << 16) & 0x1f0000ff0000ffULL;
+	value = (value | value << 8) & 0x100f00f00f00f00fULL;
+	value = (value | value << 4) & 0x10c30c30c30c30c3ULL;
+	value = (value | value << 2) & 0x1249249249249249ULL;
+	return value;
+}
+
+/**
+ * Set bits [first, last] of the bitset
+ */
+void setBits(
+		uint64_t* bits, size_t first, size_t last)
+{
+	const size_t w0 = first / 64, w1 = last / 64;
+	const uint64_t head = ~(uint64_t) 0 << (first % 64);
+	const uint64_t tail = ~(uint64_t) 0 >> (63 - last % 64);
+
+	if (w0 == w1)
+	{
+		bits[w0] |= head & tail;
+		return;
+	}
+
+	bits[w0] |= head;
+	for (size_t w = w0 + 1; w < w1; ++w)
+		bits[w] = ~(uint64_t) 0;
+	bits[w1] |= tail;
+}
+
+/**
+ * Bit i is set if pixel lut[i] (of count <= 64) is foreground
+ */
+uint64_t presentBits(
+		const int* lut, const uint64_t* foreground, int count)
+{
+	uint64_t present = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		const int pixel = lut[i];
+		if (pixel != Reconstructor::INVALID_PIXEL && Camera::isForeground(foreground, pixel)) present |= (uint64_t) 1 << i;
+	}
+	return present;
+}
+
+/**
+ * presentBits() for a full word of valid pixels, without branches
+ */
+inline uint64_t presentWord(
+		const int* lut, const uint64_t* foreground)
+{
+	uint64_t present = 0;
+	for (int i = 0; i < 64; ++i)
+		present |= ((foreground[lut[i] >> 6] >> (lut[i] & 63)) & 1) << i;
+	return present;
+}
+
+#ifdef USE_AVX2
+/**
+ * presentBits() for 8 pixels at a time: gather the 32 bit words of the foreground
+ * bits holding the pixels (skipping the invalid ones), shift each pixel's bit into
+ * the sign bit and collect the sign bits
+ */
+AVX2_TARGET uint64_t presentBitsAvx2(
+		const int* lut, const uint64_t* foreground, int count)
+{
+	const int* words = (const int*) foreground;
+	const __m256i invalid = _mm256_set1_epi32(Reconstructor::INVALID_PIXEL);
+	const __m256i bit = _mm256_set1_epi32(31);
+
+	uint64_t present = 0;
+	int i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256i pixels = _mm256_loadu_si256((const __m256i*) (lut + i));
+		const __m256i valid = _mm256_cmpgt_epi32(pixels, invalid);
+		const __m256i gathered = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), words, _mm256_srai_epi32(pixels, 5), valid, 4);
+		const __m256i bits = _mm256_sllv_epi32(gathered, _mm256_sub_epi32(bit, _mm256_and_si256(pixels, bit)));
+		present |= (uint64_t) (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(bits)) << i;
+	}
+
+	if (i < count) present |= presentBits(lut + i, foreground, count - i) << i;
+	return present;
+}
+#endif
+
+/**
+ * Find the root of grid point g's set in the union-find parents, halving the path
+ */
+int findRoot(
+		int* parents, int g)
+{
+	while (parents[g] != g)
+	{
+		parents[g] = parents[parents[g]];
+		g = parents[g];
+	}
+	return g;
+}
+
+/**
+ * Mask of a surface voxel's children that project on foreground in all cameras, bit k
+ * for child k, which has its pixel on camera c at pixels[k * cameras + c]
+ */
+uint64_t presentChildren(
+		const int* pixels, int children, const vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) foregrounds.size();
+	uint64_t present = 0;
+	for (int k = 0; k < children; ++k)
+	{
+		bool on = true;
+		for (int c = 0; c < cameras && on; ++c)
+		{
+			const int pixel = pixels[k * cameras + c];
+			on = pixel != Reconstructor::INVALID_PIXEL && Camera::isForeground(foregrounds[c], pixel);
+		}
+		if (on) present |= (uint64_t) 1 << k;
+	}
+	return present;
+}
+
+/**
+ * Unite the sets of grid points a and b, the lower root becomes the root
+ */
+void uniteRoots(
+		int* parents, int a, int b)
+{
+	a = findRoot(parents, a);
+	b = findRoot(parents, b);
+	if (a < b)
+		parents[b] = a;
+	else if (b < a)
+		parents[a] = b;
+}
+
+} /* namespace */
+
 /**
  * Constructor
  * Voxel reconstruction class
+ * The voxel space properties are read from the named file in the directory above the
+ * cameras' (General::VoxelConfigFile if no name is given)
  */
 Reconstructor::Reconstructor(
-		const vector<Camera*> &cs) :
+		const vector<Camera*> &cs, const string &config_name) :
 				m_cameras(cs),
-				m_height(2048),
-				m_step(32)
+				m_shrink_volume(false),
+				m_voxel_order(LINEAR),
+				m_lut_data(NULL),
+				m_footprint_fill(0),
+				m_footprint_data(NULL),
+				m_hierarchical(true),
+				m_vote_density(0.05f),
+				m_incremental(false),
+				m_votes_valid(false),
+				m_simd(General::hasAvx2()),
+				m_carve_word(NULL),
+				m_roi_culling(true),
+				m_max_velocity(64),
+				m_prediction_outside(0.01f),
+				m_prediction_valid(false),
+				m_predicted(false),
+				m_coloring(false),
+				m_colors_valid(false),
+				m_refine_levels(0),
+				m_mesh_smoothing(0),
+				m_mesh_valid(false),
+				m_mesh_time(0),
+				m_connectivity(0),
+				m_min_component_size(8),
+				m_tracked(0),
+				m_next_track_id(0),
+				m_track_iterations(0)
 {
 	for (size_t c = 0; c < m_cameras.size(); ++c)
 	{
@@ -37,10 +297,112 @@ Reconstructor::Reconstructor(
 			assert(m_plane_size.width == m_cameras[c]->getSize().width && m_plane_size.height == m_cameras[c]->getSize().height);
 		else
 			m_plane_size = m_cameras[c]->getSize();
+
+		m_camera_order.push_back((int) c);
+	}
+
+	// Default volume [(-2048, 2048), (-2048, 2048), (0, 2048)] with 32mm voxels, no memory budget
+	m_xL = -2048;
+	m_xR = 2048;
+	m_yL = -2048;
+	m_yR = 2048;
+	m_zL = 0;
+	m_zR = 2048;
+	m_step = 32;
+	int memory_budget = 0;  // MB, 0 is unlimited
+	int auto_coarsen = 0;
+	int hierarchical = m_hierarchical;
+	int incremental = m_incremental;
+	int roi_culling = m_roi_culling;
+	int shrink_volume = 0;
+	int coloring = m_coloring;
+	int refine_levels = 0;
+	string voxel_order = "linear";
+
+	// Read the voxel space properties (XML)
+	const string config_file = m_cameras.front()->getDataPath() + ".." + string(PATH_SEP)
+			+ (config_name.empty() ? General::VoxelConfigFile : config_name);
+	FileStorage fs;
+	fs.open(config_file, FileStorage::READ);
+	if (fs.isOpened())
+	{
+		readValue(fs["VolumeMinX"], m_xL);
+		readValue(fs["VolumeMaxX"], m_xR);
+		readValue(fs["VolumeMinY"], m_yL);
+		readValue(fs["VolumeMaxY"], m_yR);
+		readValue(fs["VolumeMinZ"], m_zL);
+		readValue(fs["VolumeMaxZ"], m_zR);
+		readValue(fs["VoxelStep"], m_step);
+		readValue(fs["MemoryBudget"], memory_budget);
+		readValue(fs["AutoCoarsen"], auto_coarsen);
+		readValue(fs["ShrinkVolume"], shrink_volume);
+		readValue(fs["HierarchicalCarving"], hierarchical);
+		readValue(fs["VoteCarvingDensity"], m_vote_density);
+		readValue(fs["IncrementalCarving"], incremental);
+		readValue(fs["RoiCulling"], roi_culling);
+		readValue(fs["FootprintFill"], m_footprint_fill);
+		readValue(fs["VoxelOrder"], voxel_order);
+		readValue(fs["VoxelColoring"], coloring);
+		readValue(fs["RefineLevels"], refine_levels);
+		readValue(fs["MeshSmoothing"], m_mesh_smoothing);
+		readValue(fs["ComponentConnectivity"], m_connectivity);
+		readValue(fs["MinComponentSize"], m_min_component_size);
+		readValue(fs["TrackedPeople"], m_tracked);
+		readValue(fs["MaxVelocity"], m_max_velocity);
+		readValue(fs["PredictionOutside"], m_prediction_outside);
+		readRegions(fs["Regions"], config_file);
+	}
+	fs.release();
+	m_hierarchical = hierarchical != 0;
+	m_incremental = incremental != 0;
+	m_roi_culling = roi_culling != 0;
+	m_shrink_volume = shrink_volume != 0;
+	m_coloring = coloring != 0;
+	m_refine_levels = std::max(0, std::min(MAX_REFINE_LEVELS, refine_levels));
+	m_mesh_smoothing = std::max(0, m_mesh_smoothing);
+
+	if (voxel_order == "linear")
+		m_voxel_order = LINEAR;
+	else if (voxel_order == "morton")
+		m_voxel_order = MORTON;
+	else if (voxel_order == "bricks")
+		m_voxel_order = BRICKS;
+	else
+	{
+		cerr << "Unknown VoxelOrder " << voxel_order << " (linear, morton or bricks) in: " << config_file << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	if (m_connectivity != 0 && m_connectivity != 6 && m_connectivity != 18 && m_connectivity != 26)
+	{
+		cerr << "Unknown ComponentConnectivity " << m_connectivity << " (0, 6, 18 or 26) in: " << config_file << endl;
+		exit(EXIT_FAILURE);
 	}
+	m_min_component_size = std::max(1, m_min_component_size);
+	m_tracked = std::max(0, m_tracked);
+
+	if (m_xR <= m_xL || m_yR <= m_yL || m_zR <= m_zL || m_step <= 0 || m_footprint_fill < 0 || m_footprint_fill > 1)
+	{
+		cerr << "Invalid voxel space in: " << config_file << endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// Double the step until the voxel space fits the memory budget, if allowed
+	const size_t budget = (size_t) memory_budget * 1024 * 1024;
+	setStep(m_step);
+	while (budget > 0 && memoryRequired() > budget && auto_coarsen && setStep(m_step * 2))
+		;
 
-	const size_t edge = 2 * m_height;
-	m_voxels_amount = (edge / m_step) * (edge / m_step) * (m_height / m_step);
+	cout << "Voxel space [(" << m_xL << ", " << m_xR << "), (" << m_yL << ", " << m_yR << "), (" << m_zL << ", " << m_zR
+			<< ")] step " << m_step << "mm: " << m_voxels_amount << " voxels, LUT " << (m_lut_bytes >> 20) << "MB, "
+			<< (memoryRequired() >> 20) << "MB in total" << endl;
+
+	if (budget > 0 && memoryRequired() > budget)
+	{
+		cerr << "The voxel space needs " << (memoryRequired() >> 20) << "MB, over the budget of " << memory_budget
+				<< "MB, increase VoxelStep or enable AutoCoarsen in: " << config_file << endl;
+		exit(EXIT_FAILURE);
+	}
 
 	initialize();
 }
@@ -53,138 +415,2100 @@ Reconstructor::~Reconstructor()
 {
 	for (size_t c = 0; c < m_corners.size(); ++c)
 		delete m_corners.at(c);
-	for (size_t v = 0; v < m_voxels.size(); ++v)
-		delete m_voxels.at(v);
+}
+
+/**
+ * Read the regions of the voxel space, each either a box (MinX, MaxX, MinY, MaxY, MinZ, MaxZ)
+ * or a floor polygon (Floor: x0 y0 x1 y1 ...) from MinZ up to MaxZ
+ * The volume becomes the bounding box of the regions.
+ */
+void Reconstructor::readRegions(
+		const FileNode &node, const string &config_file)
+{
+	if (node.empty()) return;
+
+	for (FileNodeIterator it = node.begin(); it != node.end(); ++it)
+	{
+		const FileNode &region_node = *it;
+
+		Region region;
+		region.z0 = 0;
+		region.z1 = 0;
+		readValue(region_node["MinZ"], region.z0);
+		readValue(region_node["MaxZ"], region.z1);
+
+		if (!region_node["Floor"].empty())
+		{
+			vector<float> floor;
+			region_node["Floor"] >> floor;
+			for (size_t i = 0; i + 1 < floor.size(); i += 2)
+				region.floor.push_back(Point2f(floor[i], floor[i + 1]));
+		}
+		else
+		{
+			float x0 = 0, x1 = 0, y0 = 0, y1 = 0;
+			readValue(region_node["MinX"], x0);
+			readValue(region_node["MaxX"], x1);
+			readValue(region_node["MinY"], y0);
+			readValue(region_node["MaxY"], y1);
+			if (x1 > x0 && y1 > y0)
+			{
+				region.floor.push_back(Point2f(x0, y0));
+				region.floor.push_back(Point2f(x1, y0));
+				region.floor.push_back(Point2f(x1, y1));
+				region.floor.push_back(Point2f(x0, y1));
+			}
+		}
+
+		if (region.floor.size() < 3 || region.z1 <= region.z0)
+		{
+			cerr << "Invalid region " << m_regions.size() << " in: " << config_file << endl;
+			exit(EXIT_FAILURE);
+		}
+
+		m_regions.push_back(region);
+	}
+
+	// The volume bounding the regions
+	m_xL = m_yL = m_zL = INT_MAX;
+	m_xR = m_yR = m_zR = INT_MIN;
+	for (size_t r = 0; r < m_regions.size(); ++r)
+	{
+		const Rect floor = boundingRect(m_regions[r].floor);
+		m_xL = std::min(m_xL, floor.x);
+		m_yL = std::min(m_yL, floor.y);
+		m_xR = std::max(m_xR, floor.x + floor.width);
+		m_yR = std::max(m_yR, floor.y + floor.height);
+		m_zL = std::min(m_zL, m_regions[r].z0);
+		m_zR = std::max(m_zR, m_regions[r].z1);
+	}
+}
+
+/**
+ * Set the voxel step size and derive the voxel space dimensions from it
+ * Returns false if the step leaves less than one voxel along an axis
+ */
+bool Reconstructor::setStep(
+		int step)
+{
+	if ((m_xR - m_xL) / step < 1 || (m_yR - m_yL) / step < 1 || (m_zR - m_zL) / step < 1) return false;
+
+	m_step = step;
+	m_plane_x = (m_xR - m_xL) / m_step;
+	m_plane_y = (m_yR - m_yL) / m_step;
+	m_plane_z = (m_zR - m_zL) / m_step;
+	m_voxels_amount = (size_t) m_plane_x * m_plane_y * m_plane_z;
+	m_lut_bytes = m_cameras.size() * m_voxels_amount * sizeof(int);
+
+	return true;
+}
+
+/**
+ * Bytes needed for the voxel space: the LUT plus the visible voxel and ROI bitsets, the voxels'
+ * grid and visible indices, for vote carving the pixel to voxel index (at most the LUT's size)
+ * and the votes, for orders other than LINEAR the voxel of every grid point, for refinement
+ * the child LUT cache (at most the LUT's size), the child offsets and the scratch for
+ * REFINE_CHUNK uncached voxels, for component labelling two ints per grid point, and for
+ * footprint tests the footprints and the integral images. Before pruning this is an upper bound.
+ */
+size_t Reconstructor::memoryRequired() const
+{
+	size_t bytes = m_lut_bytes + m_voxels_amount / 4 + 2 * m_voxels_amount * sizeof(int);
+	if (hasPixelIndex())
+		bytes += m_lut_bytes + m_cameras.size() * ((size_t) m_plane_size.area() + 1) * sizeof(int) + m_voxels_amount;
+	if (m_voxel_order != LINEAR)
+		bytes += m_voxels_amount * sizeof(int);
+	if (m_refine_levels > 0)
+		bytes += m_lut_bytes + m_voxels_amount * sizeof(int)
+				+ ((size_t) REFINE_CHUNK << (3 * m_refine_levels)) * m_cameras.size() * sizeof(int);
+	if (m_connectivity > 0)
+		bytes += 2 * (size_t) m_plane_x * m_plane_y * m_plane_z * sizeof(int);
+	if (m_footprint_fill > 0)
+		bytes += m_lut_bytes / 2 + m_cameras.size() * (m_plane_size.width + 1) * (m_plane_size.height + 1) * sizeof(int);
+	return bytes;
 }
 
 /**
  * Create some Look Up Tables
  * 	- LUT for the scene's box corners
- * 	- LUT with a map of the entire voxelspace: point-on-cam to voxels
  * 	- LUT with a map of the entire voxelspace: voxel to cam points-on-cam
+ *
+ * The voxels are the grid points in view of all cameras (and in a region, if the
+ * voxel space has regions), numbered in the configured VoxelOrder. Their coordinates
+ * follow from their grid index (m_voxel_ids), so the only other per voxel data is one
+ * linear pixel offset per camera (and for footprint tests the footprint's size).
  */
 void Reconstructor::initialize()
 {
-	// Cube dimensions from [(-m_height, m_height), (-m_height, m_height), (0, m_height)]
-	const int xL = -m_height;
-	const int xR = m_height;
-	const int yL = -m_height;
-	const int yR = m_height;
-	const int zL = 0;
-	const int zR = m_height;
-	const int plane_y = (yR - yL) / m_step;
-	const int plane_x = (xR - xL) / m_step;
-	const int plane = plane_y * plane_x;
+	const int plane = m_plane_y * m_plane_x;
+
+	// Reuse the LUT of an earlier run with the same calibration and volume
+	const string lut_file = m_cameras.front()->getDataPath() + ".." + string(PATH_SEP) + General::VoxelLutFile;
+	const uint64_t lut_key = lutKey();
+	if (loadLut(lut_file, lut_key))
+	{
+		cout << "Mapped " << m_voxels_amount << " voxels from " << lut_file << endl;
+	}
+	else
+	{
+		// Acquire some memory for efficiency
+		cout << "Initializing " << m_voxels_amount << " voxels ";
+		m_lut.assign(m_cameras.size() * m_voxels_amount, INVALID_PIXEL);
+
+		int zp;
+		int pdone = 0;
+#pragma omp parallel for schedule(static) private(zp) shared(pdone)
+		for (zp = 0; zp < m_plane_z; ++zp)
+		{
+			const int z = m_zL + zp * m_step;
+			int done = cvRound((zp * plane / (double) m_voxels_amount) * 100.0);
+
+#pragma omp critical
+			if (done > pdone)
+			{
+				pdone = done;
+				cout << done << "%..." << flush;
+			}
+
+			// Project the whole z-slab of voxels at once for each camera
+			vector<Point> points;
+			for (size_t c = 0; c < m_cameras.size(); ++c)
+			{
+				m_cameras[c]->projectOnViewGrid(Point3f((float) m_xL, (float) m_yL, (float) z), m_step, Size(m_plane_x, m_plane_y), points);
+
+				// If it's within the camera's FoV, save the pixel offset of the voxel projection on camera 'c'
+				//Writing the slab of voxels is not critical as it's unique (thread safe)
+				int* lut = &m_lut[c * m_voxels_amount + zp * plane];
+				for (int p = 0; p < plane; ++p)
+				{
+					const Point &point = points[p];
+					if (point.x >= 0 && point.x < m_plane_size.width && point.y >= 0 && point.y < m_plane_size.height)
+						lut[p] = point.y * m_plane_size.width + point.x;
+				}
+			}
+		}
+
+		cout << "done!" << endl;
+
+		if (m_footprint_fill > 0) initFootprints();
+		pruneLut();
+		m_lut_data = &m_lut[0];
+		m_footprint_data = m_footprints.empty() ? NULL : &m_footprints[0];
+
+		// Cache the LUT and continue on the mapped copy, which is shared with other processes
+		if (saveLut(lut_file, lut_key) && loadLut(lut_file, lut_key))
+		{
+			vector<int>().swap(m_lut);
+			vector<uint8_t>().swap(m_footprints);
+		}
+	}
+
+	m_footprint_margins.assign(m_cameras.size(), 0);
+	for (size_t c = 0; m_footprint_data && c < m_cameras.size(); ++c)
+		for (size_t i = 2 * c * m_voxels_amount; i < 2 * (c + 1) * m_voxels_amount; ++i)
+			m_footprint_margins[c] = std::max(m_footprint_margins[c], (int) m_footprint_data[i]);
+	m_integrals.resize(m_cameras.size());
 
 	// Save the 8 volume corners
 	// bottom
-	m_corners.push_back(new Point3f((float) xL, (float) yL, (float) zL));
-	m_corners.push_back(new Point3f((float) xL, (float) yR, (float) zL));
-	m_corners.push_back(new Point3f((float) xR, (float) yR, (float) zL));
-	m_corners.push_back(new Point3f((float) xR, (float) yL, (float) zL));
+	m_corners.push_back(new Point3f((float) m_xL, (float) m_yL, (float) m_zL));
+	m_corners.push_back(new Point3f((float) m_xL, (float) m_yR, (float) m_zL));
+	m_corners.push_back(new Point3f((float) m_xR, (float) m_yR, (float) m_zL));
+	m_corners.push_back(new Point3f((float) m_xR, (float) m_yL, (float) m_zL));
 
 	// top
-	m_corners.push_back(new Point3f((float) xL, (float) yL, (float) zR));
-	m_corners.push_back(new Point3f((float) xL, (float) yR, (float) zR));
-	m_corners.push_back(new Point3f((float) xR, (float) yR, (float) zR));
-	m_corners.push_back(new Point3f((float) xR, (float) yL, (float) zR));
+	m_corners.push_back(new Point3f((float) m_xL, (float) m_yL, (float) m_zR));
+	m_corners.push_back(new Point3f((float) m_xL, (float) m_yR, (float) m_zR));
+	m_corners.push_back(new Point3f((float) m_xR, (float) m_yR, (float) m_zR));
+	m_corners.push_back(new Point3f((float) m_xR, (float) m_yL, (float) m_zR));
+
+	initHierarchy();
+	initRoi();
+	if (hasPixelIndex()) initPixelIndex();
+	if (m_refine_levels > 0) m_child_offsets.assign(m_voxels_amount, -1);
+	if (m_connectivity > 0)
+	{
+		m_label_parents.resize((size_t) plane * m_plane_z);
+		m_component_ids.resize((size_t) plane * m_plane_z);
+	}
+	if (m_tracked > 0) m_floor_counts.assign(plane, 0);
+	initKernels();
+}
+
+/**
+ * Find the footprint of every grid point on every camera, from the LUT of the whole grid:
+ * the half extents of the bounding box of its cube's projection, which is spanned by the
+ * offsets to the neighbouring grid points along the three axes (clamped to 255 pixels)
+ */
+void Reconstructor::initFootprints()
+{
+	const int cameras = (int) m_cameras.size();
+	const int width = m_plane_size.width;
+	const size_t grid = m_voxels_amount;
+	const int sizes[] = { m_plane_x, m_plane_y, m_plane_z };
+	const int strides[] = { 1, m_plane_x, m_plane_x * m_plane_y };
 
-	// Acquire some memory for efficiency
-	cout << "Initializing " << m_voxels_amount << " voxels ";
-	m_voxels.resize(m_voxels_amount);
+	m_footprints.assign(2 * cameras * grid, 0);
 
-	int z;
-	int pdone = 0;
-#pragma omp parallel for schedule(static) private(z) shared(pdone)
-	for (z = zL; z < zR; z += m_step)
+	int c;
+#pragma omp parallel for schedule(static) private(c)
+	for (c = 0; c < cameras; ++c)
 	{
-		const int zp = (z - zL) / m_step;
-		int done = cvRound((zp * plane / (double) m_voxels_amount) * 100.0);
+		const int* lut = &m_lut[c * grid];
+		uint8_t* footprints = &m_footprints[2 * c * grid];
+		for (size_t g = 0; g < grid; ++g)
+		{
+			const int pixel = lut[g];
+			if (pixel == INVALID_PIXEL) continue;
 
-#pragma omp critical
-		if (done > pdone)
+			const int coordinates[] = { (int) (g % m_plane_x), (int) ((g / m_plane_x) % m_plane_y), (int) (g / strides[2]) };
+			int extent_x = 0, extent_y = 0;
+			for (int a = 0; a < 3; ++a)
+			{
+				// The next grid point along the axis, or the previous one on the volume's border
+				const int neighbour = coordinates[a] + 1 < sizes[a] ? lut[g + strides[a]] : coordinates[a] > 0 ? lut[g - strides[a]] : INVALID_PIXEL;
+				if (neighbour == INVALID_PIXEL) continue;
+
+				extent_x += abs(neighbour % width - pixel % width);
+				extent_y += abs(neighbour / width - pixel / width);
+			}
+
+			footprints[2 * g] = (uint8_t) std::min(255, (extent_x + 1) / 2);
+			footprints[2 * g + 1] = (uint8_t) std::min(255, (extent_y + 1) / 2);
+		}
+	}
+}
+
+/**
+ * Drop the grid points that are out of view of any camera from the LUT (of the whole
+ * grid), they can't be visible, and those outside the regions, if any. The remaining
+ * voxels are put in the configured voxel order.
+ * If the volume is to be shrunk, its bounds are first reduced to the bounding box of
+ * the remaining grid points.
+ */
+void Reconstructor::pruneLut()
+{
+	const int cameras = (int) m_cameras.size();
+	const size_t grid = m_voxels_amount;
+	const int plane = m_plane_x * m_plane_y;
+
+	vector<char> kept(grid, (char) m_regions.empty());
+	for (size_t r = 0; r < m_regions.size(); ++r)
+	{
+		const Region &region = m_regions[r];
+
+		// The region's floor is the same on all its slabs
+		vector<char> floor(plane);
+		for (int p = 0; p < plane; ++p)
 		{
-			pdone = done;
-			cout << done << "%..." << flush;
+			const Point2f point((float) (m_xL + (p % m_plane_x) * m_step), (float) (m_yL + (p / m_plane_x) * m_step));
+			floor[p] = pointPolygonTest(region.floor, point, false) >= 0;
 		}
 
-		int y, x;
-		for (y = yL; y < yR; y += m_step)
+		for (int zp = 0; zp < m_plane_z; ++zp)
 		{
-			const int yp = (y - yL) / m_step;
+			const int z = m_zL + zp * m_step;
+			if (z < region.z0 || z > region.z1) continue;
 
-			for (x = xL; x < xR; x += m_step)
-			{
-				const int xp = (x - xL) / m_step;
+			char* slab = &kept[(size_t) zp * plane];
+			for (int p = 0; p < plane; ++p)
+				slab[p] |= floor[p];
+		}
+	}
 
-				// Create all voxels
-				Voxel* voxel = new Voxel;
-				voxel->x = x;
-				voxel->y = y;
-				voxel->z = z;
-				voxel->camera_projection = vector<Point>(m_cameras.size());
-				voxel->valid_camera_projection = vector<int>(m_cameras.size(), 0);
+	for (int c = 0; c < cameras; ++c)
+		for (size_t g = 0; g < grid; ++g)
+			if (m_lut[c * grid + g] == INVALID_PIXEL) kept[g] = 0;
 
-				const int p = zp * plane + yp * plane_x + xp;  // The voxel's index
+	// Bounding box of the grid points kept
+	int x0 = m_plane_x, y0 = m_plane_y, z0 = m_plane_z, x1 = -1, y1 = -1, z1 = -1;
+	for (size_t g = 0; g < grid; ++g)
+	{
+		if (!kept[g]) continue;
 
-				for (size_t c = 0; c < m_cameras.size(); ++c)
-				{
-					Point point = m_cameras[c]->projectOnView(Point3f((float) x, (float) y, (float) z));
+		const int xp = (int) (g % m_plane_x), yp = (int) ((g / m_plane_x) % m_plane_y), zp = (int) (g / m_plane_x / m_plane_y);
+		x0 = std::min(x0, xp);
+		y0 = std::min(y0, yp);
+		z0 = std::min(z0, zp);
+		x1 = std::max(x1, xp);
+		y1 = std::max(y1, yp);
+		z1 = std::max(z1, zp);
+	}
+
+	if (x1 < 0)
+	{
+		cerr << "No voxel of the voxel space (regions) is in view of all cameras" << endl;
+		exit(EXIT_FAILURE);
+	}
 
-					// Save the pixel coordinates 'point' of the voxel projection on camera 'c'
-					voxel->camera_projection[(int) c] = point;
+	const int grid_x = m_plane_x, grid_y = m_plane_y;
+	if (m_shrink_volume)
+	{
+		m_xR = m_xL + (x1 + 1) * m_step;
+		m_yR = m_yL + (y1 + 1) * m_step;
+		m_zR = m_zL + (z1 + 1) * m_step;
+		m_xL += x0 * m_step;
+		m_yL += y0 * m_step;
+		m_zL += z0 * m_step;
+		setStep(m_step);
+	}
+	else
+	{
+		x0 = y0 = z0 = 0;
+	}
 
-					// If it's within the camera's FoV, flag the projection
-					if (point.x >= 0 && point.x < m_plane_size.width && point.y >= 0 && point.y < m_plane_size.height)
-						voxel->valid_camera_projection[(int) c] = 1;
-				}
+	// Grid index of every voxel, in the (shrunk) grid
+	m_voxel_ids.clear();
+	vector<size_t> sources;
+	for (size_t g = 0; g < grid; ++g)
+	{
+		if (!kept[g]) continue;
+
+		const int xp = (int) (g % grid_x) - x0, yp = (int) ((g / grid_x) % grid_y) - y0, zp = (int) (g / grid_x / grid_y) - z0;
+		m_voxel_ids.push_back((zp * m_plane_y + yp) * m_plane_x + xp);
+		sources.push_back(g);
+	}
+
+	// Put the voxels in the configured order
+	if (m_voxel_order != LINEAR)
+	{
+		vector<pair<uint64_t, int> > keys(m_voxel_ids.size());
+		for (size_t v = 0; v < m_voxel_ids.size(); ++v)
+			keys[v] = make_pair(orderKey(m_voxel_ids[v]), (int) v);
+		std::sort(keys.begin(), keys.end());
+
+		vector<int> voxel_ids(keys.size());
+		vector<size_t> ordered_sources(keys.size());
+		for (size_t v = 0; v < keys.size(); ++v)
+		{
+			voxel_ids[v] = m_voxel_ids[keys[v].second];
+			ordered_sources[v] = sources[keys[v].second];
+		}
+		m_voxel_ids.swap(voxel_ids);
+		sources.swap(ordered_sources);
+	}
+
+	m_voxels_amount = m_voxel_ids.size();
+	m_lut_bytes = cameras * m_voxels_amount * sizeof(int);
 
-				//Writing voxel 'p' is not critical as it's unique (thread safe)
-				m_voxels[p] = voxel;
+	vector<int> lut(cameras * m_voxels_amount);
+	for (int c = 0; c < cameras; ++c)
+		for (size_t v = 0; v < m_voxels_amount; ++v)
+			lut[c * m_voxels_amount + v] = m_lut[c * grid + sources[v]];
+	m_lut.swap(lut);
+
+	if (!m_footprints.empty())
+	{
+		vector<uint8_t> footprints(2 * cameras * m_voxels_amount);
+		for (int c = 0; c < cameras; ++c)
+		{
+			for (size_t v = 0; v < m_voxels_amount; ++v)
+			{
+				footprints[2 * (c * m_voxels_amount + v)] = m_footprints[2 * (c * grid + sources[v])];
+				footprints[2 * (c * m_voxels_amount + v) + 1] = m_footprints[2 * (c * grid + sources[v]) + 1];
 			}
 		}
+		m_footprints.swap(footprints);
 	}
 
-	cout << "done!" << endl;
+	cout << "Pruned " << (grid - m_voxels_amount) << " voxels out of view of a camera or the regions, " << m_voxels_amount << " voxels left";
+	if (m_shrink_volume)
+		cout << " in [(" << m_xL << ", " << m_xR << "), (" << m_yL << ", " << m_yR << "), (" << m_zL << ", " << m_zR << ")]";
+	cout << endl;
 }
 
 /**
- * Count the amount of camera's each voxel in the space appears on,
- * if that amount equals the amount of cameras, add that voxel to the
- * visible_voxels vector
+ * Sort key of the grid point in the voxel order: its grid index, its Morton code
+ * (interleaved coordinates), or its brick followed by its grid index in the brick
  */
-void Reconstructor::update()
+uint64_t Reconstructor::orderKey(
+		int grid_index) const
+{
+	const int xp = grid_index % m_plane_x, yp = (grid_index / m_plane_x) % m_plane_y, zp = grid_index / (m_plane_x * m_plane_y);
+	switch (m_voxel_order)
+	{
+	case MORTON:
+		return spreadBits(xp) | spreadBits(yp) << 1 | spreadBits(zp) << 2;
+	case BRICKS:
+	{
+		const int bricks_x = (m_plane_x + BRICK_SIZE - 1) / BRICK_SIZE, bricks_y = (m_plane_y + BRICK_SIZE - 1) / BRICK_SIZE;
+		const uint64_t brick = ((uint64_t) (zp / BRICK_SIZE) * bricks_y + yp / BRICK_SIZE) * bricks_x + xp / BRICK_SIZE;
+		return (brick * BRICK_SIZE + zp % BRICK_SIZE) * BRICK_SIZE * BRICK_SIZE + (yp % BRICK_SIZE) * BRICK_SIZE + xp % BRICK_SIZE;
+	}
+	default:
+		return grid_index;
+	}
+}
+
+/**
+ * Build the carving hierarchy bottom up: a word's rectangle on a camera bounds
+ * the pixels of its voxels in that camera's FoV, a node's rectangle bounds its
+ * children's rectangles
+ * A node is an aligned range of words, so it's only a compact spatial cell when the
+ * VoxelOrder is morton or bricks. In the linear order a node is a slab of whole grid
+ * rows whose rectangles are long and thin, and few nodes are rejected above level 0.
+ */
+void Reconstructor::initHierarchy()
 {
-	m_visible_voxels.clear();
-	std::vector<Voxel*> visible_voxels;
+	const int cameras = (int) m_cameras.size();
+	const int width = m_plane_size.width;
 
-	int v;
-#pragma omp parallel for schedule(static) private(v) shared(visible_voxels)
-	for (v = 0; v < (int) m_voxels_amount; ++v)
+	PixelRect empty;
+	empty.x0 = empty.y0 = SHRT_MAX;
+	empty.x1 = empty.y1 = -1;
+
+	m_node_rects.resize(NODE_LEVELS);
+
+	int nodes = (int) ((m_voxels_amount + 63) / 64);
+	m_node_rects[0].assign(nodes * cameras, empty);
+
+	int n;
+#pragma omp parallel for schedule(static) private(n)
+	for (n = 0; n < nodes; ++n)
 	{
-		int camera_counter = 0;
-		Voxel* voxel = m_voxels[v];
+		const int first = n * 64;
+		const int last = (int) std::min<size_t>(first + 64, m_voxels_amount);
 
-		for (size_t c = 0; c < m_cameras.size(); ++c)
+		for (int c = 0; c < cameras; ++c)
 		{
-			if (voxel->valid_camera_projection[c])
+			PixelRect &rect = m_node_rects[0][n * cameras + c];
+			const int* lut = m_lut_data + c * m_voxels_amount;
+			for (int v = first; v < last; ++v)
 			{
-				const Point point = voxel->camera_projection[c];
+				if (lut[v] == INVALID_PIXEL) continue;
 
-				//If there's a white pixel on the foreground image at the projection point, add the camera
-				if (m_cameras[c]->getForegroundImage().at<uchar>(point) == 255) ++camera_counter;
+				const short x = (short) (lut[v] % width);
+				const short y = (short) (lut[v] / width);
+				rect.x0 = std::min(rect.x0, x);
+				rect.y0 = std::min(rect.y0, y);
+				rect.x1 = std::max(rect.x1, x);
+				rect.y1 = std::max(rect.y1, y);
 			}
 		}
+	}
+
+	for (int l = 1; l < NODE_LEVELS; ++l)
+	{
+		const int children = nodes;
+		nodes = (children + 7) / 8;
+		m_node_rects[l].assign(nodes * cameras, empty);
 
-		// If the voxel is present on all cameras
-		if (camera_counter == m_cameras.size())
+		for (n = 0; n < children; ++n)
 		{
-#pragma omp critical //push_back is critical
-			visible_voxels.push_back(voxel);
+			for (int c = 0; c < cameras; ++c)
+			{
+				const PixelRect &child = m_node_rects[l - 1][n * cameras + c];
+				PixelRect &rect = m_node_rects[l][(n / 8) * cameras + c];
+				rect.x0 = std::min(rect.x0, child.x0);
+				rect.y0 = std::min(rect.y0, child.y0);
+				rect.x1 = std::max(rect.x1, child.x1);
+				rect.y1 = std::max(rect.y1, child.y1);
+			}
 		}
 	}
+}
+
+/**
+ * Find the cameras that can bound the region of interest, the ones that have the
+ * whole volume in front of them
+ */
+void Reconstructor::initRoi()
+{
+	vector<Point3f> corners;
+	for (size_t i = 0; i < m_corners.size(); ++i)
+		corners.push_back(*m_corners[i]);
+
+	m_roi_cameras.clear();
+	for (size_t c = 0; c < m_cameras.size(); ++c)
+	{
+		if (m_cameras[c]->canBackProject(corners))
+			m_roi_cameras.push_back((int) c);
+		else
+			cout << "Camera " << m_cameras[c]->getId() << " can't bound the voxel region of interest" << endl;
+	}
+
+	// The first voxel of every row of grid points along the x axis, or in other orders
+	// the voxel of every grid point
+	const int rows = m_plane_y * m_plane_z;
+	if (m_voxel_order == LINEAR)
+	{
+		m_row_voxels.assign(rows + 1, 0);
+		for (size_t v = 0; v < m_voxels_amount; ++v)
+			++m_row_voxels[m_voxel_ids[v] / m_plane_x + 1];
+		for (int row = 0; row < rows; ++row)
+			m_row_voxels[row + 1] += m_row_voxels[row];
+	}
+	else
+	{
+		m_grid_voxels.assign((size_t) rows * m_plane_x, -1);
+		for (size_t v = 0; v < m_voxels_amount; ++v)
+			m_grid_voxels[m_voxel_ids[v]] = (int) v;
+	}
+}
+
+/**
+ * Build the pixel to voxel index by inverting the LUT of every camera (a counting sort
+ * on the pixel offset), each pixel lists its voxels in ascending order
+ */
+void Reconstructor::initPixelIndex()
+{
+	const int cameras = (int) m_cameras.size();
+	const int pixels = m_plane_size.area();
+	const int voxels = (int) m_voxels_amount;
+
+	m_pixel_offsets.resize(cameras);
+	m_pixel_voxels.resize(cameras);
+
+	int c;
+#pragma omp parallel for schedule(static) private(c)
+	for (c = 0; c < cameras; ++c)
+	{
+		const int* lut = m_lut_data + c * m_voxels_amount;
+		vector<int> &offsets = m_pixel_offsets[c];
+		vector<int> &index = m_pixel_voxels[c];
+
+		offsets.assign(pixels + 1, 0);
+		for (int v = 0; v < voxels; ++v)
+			if (lut[v] != INVALID_PIXEL) ++offsets[lut[v] + 1];
+
+		for (int p = 0; p < pixels; ++p)
+			offsets[p + 1] += offsets[p];
+
+		index.resize(offsets[pixels]);
+		vector<int> next(offsets.begin(), offsets.end() - 1);
+		for (int v = 0; v < voxels; ++v)
+			if (lut[v] != INVALID_PIXEL) index[next[lut[v]]++] = v;
+	}
+}
+
+/**
+ * Hash of everything the LUT depends on: each camera's calibration,
+ * the image size and the voxel space dimensions
+ */
+uint64_t Reconstructor::lutKey() const
+{
+	uint64_t key = 14695981039346656037ULL;
+	key = hashBytes(key, &LUT_VERSION, sizeof(LUT_VERSION));
+
+	for (size_t c = 0; c < m_cameras.size(); ++c)
+	{
+		key = hashMat(key, m_cameras[c]->getCameraMatrix());
+		key = hashMat(key, m_cameras[c]->getDistortionCoeffs());
+		key = hashMat(key, m_cameras[c]->getRotationValues());
+		key = hashMat(key, m_cameras[c]->getTranslationValues());
+	}
+
+	const int volume[] = { m_plane_size.width, m_plane_size.height, m_xL, m_xR, m_yL, m_yR, m_zL, m_zR, m_step, m_shrink_volume,
+			m_footprint_fill > 0, m_voxel_order };
+	key = hashBytes(key, volume, sizeof(volume));
+
+	for (size_t r = 0; r < m_regions.size(); ++r)
+	{
+		const int heights[] = { m_regions[r].z0, m_regions[r].z1 };
+		key = hashBytes(key, heights, sizeof(heights));
+		key = hashBytes(key, &m_regions[r].floor[0], m_regions[r].floor.size() * sizeof(Point2f));
+	}
+
+	return key;
+}
+
+/**
+ * Map the LUT from the cache file, if it was written for the given key, and
+ * take the (pruned) voxels and (shrunk) volume from it
+ */
+bool Reconstructor::loadLut(
+		const string &filename, uint64_t key)
+{
+	if (!m_lut_file.open(filename)) return false;
+
+	const LutHeader* header = (const LutHeader*) m_lut_file.getData();
+	const size_t footprint_bytes = m_footprint_fill > 0 ? 2 * m_cameras.size() : 0;
+	if (m_lut_file.getSize() < sizeof(LutHeader) || memcmp(header->magic, LUT_MAGIC, sizeof(LUT_MAGIC)) != 0
+			|| header->version != LUT_VERSION || header->cameras != m_cameras.size() || header->key != key
+			|| m_lut_file.getSize() != sizeof(LutHeader) + ((m_cameras.size() + 1) * sizeof(int) + footprint_bytes) * header->voxels)
+	{
+		m_lut_file.close();
+		return false;
+	}
+
+	m_xL = header->bounds[0];
+	m_xR = header->bounds[1];
+	m_yL = header->bounds[2];
+	m_yR = header->bounds[3];
+	m_zL = header->bounds[4];
+	m_zR = header->bounds[5];
+	setStep(m_step);
+
+	m_voxels_amount = (size_t) header->voxels;
+	m_lut_bytes = m_cameras.size() * m_voxels_amount * sizeof(int);
+	m_lut_data = (const int*) ((const char*) m_lut_file.getData() + sizeof(LutHeader));
+
+	const int* voxel_ids = m_lut_data + m_cameras.size() * m_voxels_amount;
+	m_voxel_ids.assign(voxel_ids, voxel_ids + m_voxels_amount);
+	if (footprint_bytes > 0) m_footprint_data = (const uint8_t*) (voxel_ids + m_voxels_amount);
+	return true;
+}
+
+/**
+ * Write the LUT to the cache file
+ * The file is written aside under a per process name and then moved over the
+ * old one, so processes that have the old file mapped are unaffected and
+ * processes building the LUT at the same time don't write into each other's file
+ */
+bool Reconstructor::saveLut(
+		const string &filename, uint64_t key) const
+{
+	LutHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, LUT_MAGIC, sizeof(LUT_MAGIC));
+	header.version = LUT_VERSION;
+	header.cameras = (uint32_t) m_cameras.size();
+	header.key = key;
+	header.voxels = m_voxels_amount;
+	const int32_t bounds[] = { m_xL, m_xR, m_yL, m_yR, m_zL, m_zR };
+	memcpy(header.bounds, bounds, sizeof(bounds));
+
+	const string tmp_filename = MappedFile::tempName(filename);
+	ofstream ofile(tmp_filename.c_str(), ios::binary | ios::trunc);
+	ofile.write((const char*) &header, sizeof(header));
+	ofile.write((const char*) &m_lut[0], m_lut.size() * sizeof(int));
+	ofile.write((const char*) &m_voxel_ids[0], m_voxel_ids.size() * sizeof(int));
+	if (!m_footprints.empty()) ofile.write((const char*) &m_footprints[0], m_footprints.size());
+	ofile.close();
+
+	if (!ofile)
+	{
+		cerr << "Unable to write the voxel LUT to: " << tmp_filename << endl;
+		remove(tmp_filename.c_str());
+		return false;
+	}
+
+	if (!MappedFile::replace(tmp_filename, filename))
+	{
+		cerr << "Unable to write the voxel LUT to: " << filename << endl;
+		remove(tmp_filename.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Find the region of interest: the intersection of the pyramids of rays through
+ * each camera's (padded) foreground box, into the ROI bitset
+ * A voxel only projects on foreground if it projects in the foreground box of every
+ * camera, so no visible voxel is outside the region. The padding covers the LUT's
+ * rounding to whole pixels, and the footprints that reach foreground from outside the box.
+ * Every row of voxels along the x axis crosses the convex
+ * region in a single run of voxels, which follows from the row's distance to each plane.
+ * Without ROI culling (or cameras that bound it) the region is the whole volume.
+ * If the region is predicted from the last update, it's limited to the prediction.
+ */
+void Reconstructor::computeRoi()
+{
+	m_roi_bits.assign((m_voxels_amount + 63) / 64, 0);
+
+	// The run of each row [x0, x1], empty if x0 > x1
+	const int rows = m_plane_y * m_plane_z;
+	vector<int> runs(2 * rows);
+	for (int row = 0; row < rows; ++row)
+		runs[2 * row + 1] = -1;
+
+	vector<Vec4f> planes;
+	for (size_t i = 0; m_roi_culling && i < m_roi_cameras.size(); ++i)
+	{
+		const Rect &box = m_cameras[m_roi_cameras[i]]->getForegroundBox();
+		if (box.area() == 0) return;
+
+		const int padding = ROI_PADDING + m_footprint_margins[m_roi_cameras[i]];
+		const Rect padded(box.x - padding, box.y - padding, box.width + 2 * padding, box.height + 2 * padding);
+		m_cameras[m_roi_cameras[i]]->backProjectRect(padded, planes);
+	}
+
+	VoxelBox region = { 0, 0, 0, m_plane_x - 1, m_plane_y - 1, m_plane_z - 1 };
+	m_predicted = predictRegion(region);
+	if (region.x0 > region.x1) return;
+
+	// Voxel (xp, yp, zp) is in front of a plane with a != 0 if xp >= (or <=, for a < 0) x0 + dy * yp + dz * zp
+	const int count = (int) planes.size();
+	vector<double> x0s(count), dys(count), dzs(count);
+	for (int p = 0; p < count; ++p)
+	{
+		const Vec4f &plane = planes[p];
+		x0s[p] = -(plane[0] * m_xL + plane[1] * m_yL + plane[2] * m_zL + plane[3]) / (plane[0] * m_step);
+		dys[p] = -plane[1] / plane[0];
+		dzs[p] = -plane[2] / plane[0];
+	}
+
+	int zp;
+#pragma omp parallel for schedule(static) private(zp)
+	for (zp = region.z0; zp <= region.z1; ++zp)
+	{
+		// The region is convex, so past the rows whose (unrounded) interval crosses it the
+		// slab's rows are empty; a row's interval can still hold no voxel in between rows
+		// that hold some, near a slanted tip of the region
+		bool crossed = false;
+		for (int yp = region.y0; yp <= region.y1; ++yp)
+		{
+			double x0 = region.x0 - 1e-3, x1 = region.x1 + 1e-3;
+			for (int p = 0; p < count && x0 <= x1; ++p)
+			{
+				const float a = planes[p][0];
+				if (a == 0)
+				{
+					const Vec4f &plane = planes[p];
+					if (plane[1] * (m_yL + yp * m_step) + plane[2] * (m_zL + zp * m_step) + plane[3] < 0) x1 = -DBL_MAX;
+					continue;
+				}
+
+				const double bound = x0s[p] + dys[p] * yp + dzs[p] * zp;
+				if (a > 0)
+					x0 = std::max(x0, bound - 1e-3);
+				else
+					x1 = std::min(x1, bound + 1e-3);
+			}
+
+			if (x0 > x1)
+			{
+				if (crossed) break;
+				continue;
+			}
+			crossed = true;
+
+			x0 = ceil(x0);
+			x1 = floor(x1);
+			if (x0 > x1) continue;
+
+			const int row = zp * m_plane_y + yp;
+			runs[2 * row] = (int) x0;
+			runs[2 * row + 1] = (int) x1;
+		}
+	}
+
+	// Rows may share words, so the runs are written one after the other
+	const int* voxel_ids = &m_voxel_ids[0];
+	for (int row = 0; row < rows; ++row)
+	{
+		if (runs[2 * row] > runs[2 * row + 1]) continue;
+
+		if (m_voxel_order != LINEAR)
+		{
+			for (int xp = runs[2 * row]; xp <= runs[2 * row + 1]; ++xp)
+			{
+				const int v = m_grid_voxels[(size_t) row * m_plane_x + xp];
+				if (v >= 0) m_roi_bits[v / 64] |= (uint64_t) 1 << (v % 64);
+			}
+			continue;
+		}
+
+		// The row's voxels in the run, grid points out of view of a camera aren't voxels
+		const int* row_first = voxel_ids + m_row_voxels[row];
+		const int* row_last = voxel_ids + m_row_voxels[row + 1];
+		const int* first = std::lower_bound(row_first, row_last, row * m_plane_x + runs[2 * row]);
+		const int* last = std::upper_bound(first, row_last, row * m_plane_x + runs[2 * row + 1]);
+		if (first < last)
+			setBits(&m_roi_bits[0], (size_t) (first - voxel_ids), (size_t) (last - voxel_ids) - 1);
+	}
+}
+
+/**
+ * Predict the region of the visible voxels from the last update's: its bounding box
+ * of visible voxels, grown by the distance people can move in one frame
+ * The prediction fails if any camera has more than the allowed fraction of its
+ * foreground outside the projection of the predicted region, for instance when
+ * someone walks in or the scene cuts. All of that foreground counts in every update,
+ * also what no visible voxel explained before: leaving it out would let someone who
+ * came in unnoticed stay out of the region for good. Foreground that is never
+ * explained (out of view of other cameras, noise) thus takes from the allowed
+ * fraction. It also fails after a seek.
+ */
+bool Reconstructor::predictRegion(
+		VoxelBox &region) const
+{
+	if (m_max_velocity <= 0 || !m_prediction_valid || m_roi_cameras.empty()) return false;
+
+	const int margin = (m_max_velocity + m_step - 1) / m_step;
+	VoxelBox predicted = m_visible_box;
+	if (predicted.x0 <= predicted.x1)
+	{
+		predicted.x0 = std::max(0, predicted.x0 - margin);
+		predicted.y0 = std::max(0, predicted.y0 - margin);
+		predicted.z0 = std::max(0, predicted.z0 - margin);
+		predicted.x1 = std::min(m_plane_x - 1, predicted.x1 + margin);
+		predicted.y1 = std::min(m_plane_y - 1, predicted.y1 + margin);
+		predicted.z1 = std::min(m_plane_z - 1, predicted.z1 + margin);
+	}
+
+	for (size_t i = 0; i < m_roi_cameras.size(); ++i)
+	{
+		const Camera* camera = m_cameras[m_roi_cameras[i]];
+		const int outside = camera->getForegroundArea() - camera->countForeground(projectBox(camera, predicted));
+		if (outside > m_prediction_outside * camera->getForegroundArea()) return false;
+	}
+
+	region = predicted;
+	return true;
+}
+
+/**
+ * Bounding box of the projection of the voxel box's corners on the camera, padded
+ * like the foreground boxes (empty for an empty voxel box)
+ */
+Rect Reconstructor::projectBox(
+		const Camera* camera, const VoxelBox &box) const
+{
+	if (box.x0 > box.x1) return Rect();
+
+	vector<Point3f> corners;
+	for (int i = 0; i < 8; ++i)
+		corners.push_back(Point3f(
+				(float) (m_xL + ((i & 1) ? box.x1 : box.x0) * m_step),
+				(float) (m_yL + ((i & 2) ? box.y1 : box.y0) * m_step),
+				(float) (m_zL + ((i & 4) ? box.z1 : box.z0) * m_step)));
+
+	vector<Point2f> points;
+	camera->projectOnView(corners, points);
+	const Rect projection = boundingRect(points);
+	return Rect(projection.x - ROI_PADDING, projection.y - ROI_PADDING, projection.width + 2 * ROI_PADDING,
+			projection.height + 2 * ROI_PADDING);
+}
+
+/**
+ * Find the bounding box of the visible voxels, for the next update's prediction
+ */
+void Reconstructor::boundVisible()
+{
+	const VoxelBox empty = { INT_MAX, INT_MAX, INT_MAX, -1, -1, -1 };
+	m_visible_box = empty;
+
+	const int plane = m_plane_x * m_plane_y;
+	for (size_t i = 0; i < m_visible_voxels.size(); ++i)
+	{
+		const int v = m_voxel_ids[m_visible_voxels[i]];
+		const int xp = v % m_plane_x, yp = (v % plane) / m_plane_x, zp = v / plane;
+		m_visible_box.x0 = std::min(m_visible_box.x0, xp);
+		m_visible_box.y0 = std::min(m_visible_box.y0, yp);
+		m_visible_box.z0 = std::min(m_visible_box.z0, zp);
+		m_visible_box.x1 = std::max(m_visible_box.x1, xp);
+		m_visible_box.y1 = std::max(m_visible_box.y1, yp);
+		m_visible_box.z1 = std::max(m_visible_box.z1, zp);
+	}
+
+	m_prediction_valid = true;
+}
+
+/**
+ * Whether words [first, last) of the region of interest are empty
+ */
+bool Reconstructor::isRoiEmpty(
+		int first, int last) const
+{
+	for (int w = first; w < last; ++w)
+		if (m_roi_bits[w]) return false;
+	return true;
+}
+
+/**
+ * Carve one word (64 voxels) of the voxel space: for every camera a word gets
+ * bit i set if voxel i projects on a foreground pixel, the AND of those words
+ * over all cameras holds the voxels that are present on all cameras
+ * The cameras are tested in rank order and the word is done as soon as it's
+ * empty, the voxels each camera was tested on and rejected are counted. Sample
+ * words are tested on all cameras, to measure each camera's rejection rate
+ * independent of the order. Only the voxels in the region of interest are carved.
+ * With footprint tests a voxel is present if enough of its footprint is foreground.
+ */
+uint64_t Reconstructor::carveWord(
+		int w, const std::vector<const uint64_t*> &foregrounds, CameraStats* stats) const
+{
+	const uint64_t voxels = m_roi_bits[w];
+	if (!voxels) return 0;
+
+	const int first = w * 64;
+	const int count = (int) std::min<size_t>(64, m_voxels_amount - first);
+	const bool sample = w % SAMPLE_WORDS == 0;
+	uint64_t visible = voxels;
+
+	for (size_t k = 0; k < m_cameras.size() && (visible || sample); ++k)
+	{
+		const int c = m_camera_order[k];
+		const int* lut = m_lut_data + c * m_voxels_amount + first;
+		const uint64_t* foreground = foregrounds[c];
+
+#ifdef USE_AVX2
+		const uint64_t present = m_footprint_data ? presentFootprints(c, first, sample ? voxels : visible) :
+				m_simd ? presentBitsAvx2(lut, foreground, count) : presentBits(lut, foreground, count);
+		assert(m_footprint_data || !m_simd || present == presentBits(lut, foreground, count));
+#else
+		const uint64_t present = m_footprint_data ? presentFootprints(c, first, sample ? voxels : visible) :
+				presentBits(lut, foreground, count);
+#endif
+
+		stats[c].tested += General::bitCount(visible);
+		stats[c].rejected += General::bitCount(visible & ~present);
+		visible &= present;
+
+		if (sample)
+		{
+			stats[c].sampled += General::bitCount(voxels);
+			stats[c].sample_rejected += General::bitCount(voxels & ~present);
+		}
+	}
+
+	return visible;
+}
+
+/**
+ * carveWord() for a fixed amount of cameras, chosen at runtime by initKernels()
+ * The camera loop has a constant trip count and full words skip the checks for
+ * invalid pixels (after pruning every voxel is in view of all cameras) and for the
+ * word's length, the last word and footprint tests are left to carveWord().
+ */
+template<int CAMERAS>
+uint64_t Reconstructor::carveWordFixed(
+		int w, const std::vector<const uint64_t*> &foregrounds, CameraStats* stats) const
+{
+	const uint64_t voxels = m_roi_bits[w];
+	if (!voxels) return 0;
+
+	const size_t first = (size_t) w * 64;
+	if (first + 64 > m_voxels_amount) return carveWord(w, foregrounds, stats);
+
+	const bool sample = w % SAMPLE_WORDS == 0;
+	uint64_t visible = voxels;
+
+	for (int k = 0; k < CAMERAS; ++k)
+	{
+		const int c = m_camera_order[k];
+		const int* lut = m_lut_data + c * m_voxels_amount + first;
+		const uint64_t* foreground = foregrounds[c];
+
+#ifdef USE_AVX2
+		const uint64_t present = m_simd ? presentBitsAvx2(lut, foreground, 64) : presentWord(lut, foreground);
+#else
+		const uint64_t present = presentWord(lut, foreground);
+#endif
+		assert(present == presentBits(lut, foreground, 64));
+
+		stats[c].tested += General::bitCount(visible);
+		stats[c].rejected += General::bitCount(visible & ~present);
+		visible &= present;
+
+		if (sample)
+		{
+			stats[c].sampled += General::bitCount(voxels);
+			stats[c].sample_rejected += General::bitCount(voxels & ~present);
+		}
+		else if (!visible)
+			break;
+	}
+
+	return visible;
+}
+
+/**
+ * Choose the word carving kernel for the amount of cameras: the kernels for 2 to 8
+ * cameras are specialized, other amounts and footprint tests use the generic one
+ */
+void Reconstructor::initKernels()
+{
+	m_carve_word = &Reconstructor::carveWord;
+	if (m_footprint_data) return;
+
+	switch (m_cameras.size())
+	{
+	case 2:
+		m_carve_word = &Reconstructor::carveWordFixed<2>;
+		break;
+	case 3:
+		m_carve_word = &Reconstructor::carveWordFixed<3>;
+		break;
+	case 4:
+		m_carve_word = &Reconstructor::carveWordFixed<4>;
+		break;
+	case 5:
+		m_carve_word = &Reconstructor::carveWordFixed<5>;
+		break;
+	case 6:
+		m_carve_word = &Reconstructor::carveWordFixed<6>;
+		break;
+	case 7:
+		m_carve_word = &Reconstructor::carveWordFixed<7>;
+		break;
+	case 8:
+		m_carve_word = &Reconstructor::carveWordFixed<8>;
+		break;
+	default:
+		break;
+	}
+}
+
+/**
+ * Test the voxels of the mask in the word starting at voxel first on camera c: bit i is
+ * set if at least the footprint fill of voxel i's footprint is foreground, which the
+ * integral image of the foreground sums in four lookups. Outside the image is background.
+ */
+uint64_t Reconstructor::presentFootprints(
+		int c, int first, uint64_t mask) const
+{
+	const int width = m_plane_size.width, height = m_plane_size.height;
+	const int* lut = m_lut_data + c * m_voxels_amount + first;
+	const uint8_t* footprints = m_footprint_data + 2 * (c * m_voxels_amount + first);
+	const Mat &sums = m_integrals[c];
+
+	uint64_t present = 0;
+	for (; mask; mask &= mask - 1)
+	{
+		const int i = General::lowestBit(mask);
+		const int pixel = lut[i];
+		if (pixel == INVALID_PIXEL) continue;
+
+		const int half_width = footprints[2 * i], half_height = footprints[2 * i + 1];
+		const int x = pixel % width, y = pixel / width;
+		const int x0 = std::max(0, x - half_width), x1 = std::min(width, x + half_width + 1);
+		const int y0 = std::max(0, y - half_height), y1 = std::min(height, y + half_height + 1);
+
+		const int* top = sums.ptr<int>(y0);
+		const int* bottom = sums.ptr<int>(y1);
+		const int foreground = bottom[x1] - bottom[x0] - top[x1] + top[x0];
+		if (foreground >= m_footprint_fill * 255 * (2 * half_width + 1) * (2 * half_height + 1))
+			present |= (uint64_t) 1 << i;
+	}
+
+	return present;
+}
+
+/**
+ * Carve every word of the voxel space into the visible voxels bitset
+ */
+void Reconstructor::carveDense(
+		const std::vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) m_cameras.size();
+	const int words = (int) m_visible_bits.size();
+
+	computeRoi();
+
+#pragma omp parallel
+	{
+		std::vector<CameraStats> stats(cameras, CameraStats());
+
+		int w;
+#pragma omp for schedule(static)
+		for (w = 0; w < words; ++w)
+			m_visible_bits[w] = (this->*m_carve_word)(w, foregrounds, &stats[0]);
+
+		addStats(stats);
+	}
+}
+
+/**
+ * Carve the voxel space coarse to fine into the visible voxels bitset, starting
+ * from the top level nodes of the hierarchy
+ */
+void Reconstructor::carveHierarchical(
+		const std::vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) m_cameras.size();
+	const int nodes = (int) (m_node_rects[NODE_LEVELS - 1].size() / cameras);
+
+	std::fill(m_visible_bits.begin(), m_visible_bits.end(), 0);
+	computeRoi();
+
+#pragma omp parallel
+	{
+		std::vector<CameraStats> stats(cameras, CameraStats());
+
+		int n;
+#pragma omp for schedule(dynamic)
+		for (n = 0; n < nodes; ++n)
+			carveNode(NODE_LEVELS - 1, n, foregrounds, &stats[0]);
+
+		addStats(stats);
+	}
+}
+
+/**
+ * Carve node n on the given level of the hierarchy
+ * Nodes outside the region of interest are skipped.
+ * If any camera has no foreground in the node's rectangle, none of the node's
+ * voxels can be visible and its words stay empty, otherwise the node's children
+ * are carved. On the lowest level the node is a single word, which is carved
+ * voxel by voxel, so the result is the same as carving every word.
+ * A rejected node counts all its voxels as tested by the cameras up to and
+ * including the one that rejected it.
+ */
+void Reconstructor::carveNode(
+		int level, int n, const std::vector<const uint64_t*> &foregrounds, CameraStats* stats)
+{
+	const int cameras = (int) m_cameras.size();
+	const int words = (int) m_visible_bits.size();
+	if (isRoiEmpty(n << (3 * level), std::min(words, (n + 1) << (3 * level)))) return;
+
+	for (int k = 0; k < cameras; ++k)
+	{
+		const int c = m_camera_order[k];
+		const PixelRect &rect = m_node_rects[level][n * cameras + c];
+		if (rect.x0 > rect.x1 || !m_cameras[c]->hasForeground(rect.x0, rect.y0, rect.x1, rect.y1))
+		{
+			const size_t first = (size_t) n << (3 * level + 6);
+			const size_t voxels = std::min(m_voxels_amount, ((size_t) n + 1) << (3 * level + 6)) - first;
+			for (int j = 0; j <= k; ++j)
+				stats[m_camera_order[j]].tested += voxels;
+			stats[c].rejected += voxels;
+			return;
+		}
+	}
+
+	if (level == 0)
+	{
+		m_visible_bits[n] = (this->*m_carve_word)(n, foregrounds, stats);
+		return;
+	}
+
+	const int children = (int) (m_node_rects[level - 1].size() / cameras);
+	const int last = std::min(children, (n + 1) * 8);
+	for (int child = n * 8; child < last; ++child)
+		carveNode(level - 1, child, foregrounds, stats);
+}
+
+/**
+ * Add a thread's carving statistics to the update's
+ */
+void Reconstructor::addStats(
+		const std::vector<CameraStats> &stats)
+{
+#pragma omp critical
+	for (size_t c = 0; c < stats.size(); ++c)
+	{
+		m_camera_stats[c].tested += stats[c].tested;
+		m_camera_stats[c].rejected += stats[c].rejected;
+		m_camera_stats[c].sampled += stats[c].sampled;
+		m_camera_stats[c].sample_rejected += stats[c].sample_rejected;
+	}
+}
+
+/**
+ * Rank the cameras by the fraction of the sampled voxels they rejected in the
+ * last update, highest first, so that carving a word needs as few cameras as possible
+ * The sample words are tested on all cameras, so unlike the rejections during
+ * carving the rate doesn't depend on the cameras that were tested before.
+ */
+void Reconstructor::rankCameras()
+{
+	const int cameras = (int) m_cameras.size();
+
+	std::vector<std::pair<double, int> > rates;
+	for (int c = 0; c < cameras; ++c)
+	{
+		if (m_camera_stats[c].sampled == 0) return;
+		rates.push_back(std::make_pair(-(double) m_camera_stats[c].sample_rejected / m_camera_stats[c].sampled, c));
+	}
+
+	std::stable_sort(rates.begin(), rates.end());
+	for (int k = 0; k < cameras; ++k)
+		m_camera_order[k] = rates[k].second;
+}
+
+/**
+ * Count for every voxel the cameras on which it projects on foreground, and set
+ * the voxels that are on foreground on all cameras in the visible voxels bitset
+ */
+void Reconstructor::countVotes(
+		const std::vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) m_cameras.size();
+	const int words = (int) m_visible_bits.size();
+
+	m_votes.resize(m_voxels_amount);
+
+	int w;
+#pragma omp parallel for schedule(static) private(w)
+	for (w = 0; w < words; ++w)
+	{
+		const int first = w * 64;
+		const int count = (int) std::min<size_t>(64, m_voxels_amount - first);
+
+		uint64_t visible = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			uint8_t votes = 0;
+			for (int c = 0; c < cameras; ++c)
+			{
+				const int pixel = m_lut_data[c * m_voxels_amount + first + i];
+				if (pixel != INVALID_PIXEL && Camera::isForeground(foregrounds[c], pixel)) ++votes;
+			}
+
+			m_votes[first + i] = votes;
+			if (votes == cameras) visible |= (uint64_t) 1 << i;
+		}
+
+		m_visible_bits[w] = visible;
+	}
+}
+
+/**
+ * Count the votes of every voxel pixel by pixel: for every foreground pixel of a
+ * camera add a vote to the voxels in its pixel index entry, the voxels that get
+ * the vote of the last camera are visible
+ * Only the voxels projecting on foreground are touched, which beats carving every
+ * voxel when the silhouettes are small. The cameras are done one after the other,
+ * as within one camera every voxel projects on a single pixel the pixels of a
+ * camera are processed in parallel without races on the votes. The bitset words
+ * are shared between pixels, so these are updated atomically.
+ */
+void Reconstructor::accumulateVotes(
+		const std::vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) m_cameras.size();
+	const int pixel_words = (m_plane_size.area() + 63) / 64;
+
+	if (m_pixel_voxels.empty()) initPixelIndex();
+	m_votes.assign(m_voxels_amount, 0);
+	std::fill(m_visible_bits.begin(), m_visible_bits.end(), 0);
+
+	for (int c = 0; c < cameras; ++c)
+	{
+		const uint64_t* foreground = foregrounds[c];
+		const int* offsets = &m_pixel_offsets[c][0];
+		const int* index = m_pixel_voxels[c].empty() ? NULL : &m_pixel_voxels[c][0];
+
+		int w;
+#pragma omp parallel for schedule(dynamic, 16) private(w)
+		for (w = 0; w < pixel_words; ++w)
+		{
+			for (uint64_t bits = foreground[w]; bits; bits &= bits - 1)
+			{
+				const int pixel = w * 64 + General::lowestBit(bits);
+				for (int i = offsets[pixel]; i < offsets[pixel + 1]; ++i)
+				{
+					const int v = index[i];
+					if (++m_votes[v] == cameras)
+					{
+#pragma omp atomic
+						m_visible_bits[v / 64] |= (uint64_t) 1 << (v % 64);
+					}
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Whether the fraction of foreground pixels over all cameras is below the vote
+ * density, so accumulating votes pixel by pixel is cheaper than carving voxel by voxel
+ */
+bool Reconstructor::isSparse(
+		const std::vector<const uint64_t*> &foregrounds) const
+{
+	if (m_vote_density <= 0) return false;
+
+	const int pixel_words = (m_plane_size.area() + 63) / 64;
+
+	size_t pixels = 0;
+	for (size_t c = 0; c < m_cameras.size(); ++c)
+		for (int w = 0; w < pixel_words; ++w)
+			pixels += General::bitCount(foregrounds[c][w]);
+
+	return pixels < m_vote_density * m_cameras.size() * m_plane_size.area();
+}
+
+/**
+ * Whether any of the carving modes needs the pixel to voxel index
+ */
+bool Reconstructor::hasPixelIndex() const
+{
+	return m_footprint_fill <= 0 && (m_incremental || m_vote_density > 0);
+}
+
+/**
+ * Carve only the voxels whose votes changed since the last update
+ * 	- diff each camera's foreground bits against the last update's, a flipped
+ * 	  pixel adds or removes a vote for every voxel in its pixel index entry
+ * 	- update the visible bit of every voxel on a flipped pixel from its votes
+ * Within one camera every voxel projects on a single pixel, so the flipped pixels
+ * of a camera are processed in parallel without races on the votes. The bitset
+ * words are shared between pixels, so these are updated atomically.
+ * Without a (valid) last update all votes are counted from scratch.
+ */
+void Reconstructor::carveIncremental(
+		const std::vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) m_cameras.size();
+	const int pixel_words = (m_plane_size.area() + 63) / 64;
+
+	if (m_pixel_voxels.empty()) initPixelIndex();
+
+	if (!m_votes_valid || m_votes.size() != m_voxels_amount)
+	{
+		if (isSparse(foregrounds))
+			accumulateVotes(foregrounds);
+		else
+			countVotes(foregrounds);
+	}
+	else
+	{
+		std::vector<std::vector<int> > flipped(cameras);
+		for (int c = 0; c < cameras; ++c)
+		{
+			const uint64_t* previous = &m_previous_foregrounds[c][0];
+			for (int w = 0; w < pixel_words; ++w)
+				for (uint64_t changed = foregrounds[c][w] ^ previous[w]; changed; changed &= changed - 1)
+					flipped[c].push_back(w * 64 + General::lowestBit(changed));
+
+			const int* offsets = &m_pixel_offsets[c][0];
+			const int* index = m_pixel_voxels[c].empty() ? NULL : &m_pixel_voxels[c][0];
+			const int count = (int) flipped[c].size();
+
+			int f;
+#pragma omp parallel for schedule(dynamic, 64) private(f)
+			for (f = 0; f < count; ++f)
+			{
+				const int pixel = flipped[c][f];
+				const bool added = Camera::isForeground(foregrounds[c], pixel);
+				for (int i = offsets[pixel]; i < offsets[pixel + 1]; ++i)
+				{
+					if (added)
+						++m_votes[index[i]];
+					else
+						--m_votes[index[i]];
+				}
+			}
+		}
+
+		for (int c = 0; c < cameras; ++c)
+		{
+			const int* offsets = &m_pixel_offsets[c][0];
+			const int* index = m_pixel_voxels[c].empty() ? NULL : &m_pixel_voxels[c][0];
+			const int count = (int) flipped[c].size();
+
+			int f;
+#pragma omp parallel for schedule(dynamic, 64) private(f)
+			for (f = 0; f < count; ++f)
+			{
+				const int pixel = flipped[c][f];
+				for (int i = offsets[pixel]; i < offsets[pixel + 1]; ++i)
+				{
+					const int v = index[i];
+					const uint64_t bit = (uint64_t) 1 << (v % 64);
+					uint64_t &word = m_visible_bits[v / 64];
+					if (m_votes[v] == cameras)
+					{
+#pragma omp atomic
+						word |= bit;
+					}
+					else
+					{
+#pragma omp atomic
+						word &= ~bit;
+					}
+				}
+			}
+		}
+	}
+
+	m_previous_foregrounds.resize(cameras);
+	for (int c = 0; c < cameras; ++c)
+		m_previous_foregrounds[c].assign(foregrounds[c], foregrounds[c] + pixel_words);
+	m_votes_valid = true;
+}
+
+/**
+ * Switch the AVX2 carving kernel on or off, it stays off if the CPU doesn't support it
+ */
+void Reconstructor::setSimd(
+		bool simd)
+{
+	m_simd = simd && General::hasAvx2();
+}
+
+/**
+ * Switch incremental carving on or off, the next update starts from scratch
+ */
+void Reconstructor::setIncremental(
+		bool incremental)
+{
+	m_incremental = incremental;
+	m_votes_valid = false;
+}
+
+/**
+ * Compact the visible voxels bitset into the visible_voxels vector without locking:
+ * 	- count the visible voxels per chunk of words
+ * 	- prefix sum the counts into each chunk's output offset
+ * 	- scatter each chunk's voxel indices from its offset
+ * The result is sorted by voxel index, whatever the amount of threads
+ */
+void Reconstructor::compactVisible()
+{
+	const int words = (int) m_visible_bits.size();
+	const int chunks = (words + CHUNK_WORDS - 1) / CHUNK_WORDS;
+	std::vector<int> offsets(chunks + 1, 0);
+
+	int k;
+#pragma omp parallel for schedule(static) private(k)
+	for (k = 0; k < chunks; ++k)
+	{
+		const int end = std::min(words, (k + 1) * CHUNK_WORDS);
+
+		int count = 0;
+		for (int w = k * CHUNK_WORDS; w < end; ++w)
+			count += General::bitCount(m_visible_bits[w]);
+		offsets[k + 1] = count;
+	}
+
+	for (k = 0; k < chunks; ++k)
+		offsets[k + 1] += offsets[k];
+
+	m_visible_voxels.resize(offsets[chunks]);
+
+#pragma omp parallel for schedule(static) private(k)
+	for (k = 0; k < chunks; ++k)
+	{
+		const int end = std::min(words, (k + 1) * CHUNK_WORDS);
+
+		int* out = m_visible_voxels.empty() ? NULL : &m_visible_voxels[offsets[k]];
+		for (int w = k * CHUNK_WORDS; w < end; ++w)
+			for (uint64_t visible = m_visible_bits[w]; visible; visible &= visible - 1)
+				*out++ = w * 64 + General::lowestBit(visible);
+	}
+}
+
+/**
+ * Carve the voxel space into the visible voxels bitset, incrementally from the
+ * last update, by accumulating the votes of the foreground pixels if these are
+ * sparse, or else coarse to fine or word by word (all give the same result), and
+ * compact it into the sorted visible_voxels vector
+ * Footprint tests are only done word by word, on the integral images of the foregrounds.
+ * Carving coarse to fine or word by word counts per camera the voxels it was tested on
+ * and rejected, the rejection rates on the samples re-rank the cameras for the next update
+ * The bounding box of the visible voxels predicts the next update's region
+ * The visible voxels on the surface are kept alongside, and refined at a finer step if
+ * configured. The visible voxels are labelled by connected component and the people on
+ * the floor are tracked, if configured. The voxels are coloured and meshed when their
+ * colours or mesh are first asked for.
+ */
+void Reconstructor::update()
+{
+	std::vector<const uint64_t*> foregrounds(m_cameras.size());
+	for (size_t c = 0; c < m_cameras.size(); ++c)
+		foregrounds[c] = &m_cameras[c]->getForegroundBits()[0];
+
+	m_visible_bits.resize((m_voxels_amount + 63) / 64);
+	m_camera_stats.assign(m_cameras.size(), CameraStats());
+	m_predicted = false;
+
+	if (m_footprint_data)
+	{
+		for (size_t c = 0; c < m_cameras.size(); ++c)
+			integral(m_cameras[c]->getForegroundImage(), m_integrals[c], CV_32S);
+		carveDense(foregrounds);
+	}
+	else if (m_incremental)
+		carveIncremental(foregrounds);
+	else if (isSparse(foregrounds))
+		accumulateVotes(foregrounds);
+	else if (m_hierarchical)
+		carveHierarchical(foregrounds);
+	else
+		carveDense(foregrounds);
+
+	rankCameras();
+	compactVisible();
+	boundVisible();
+	findSurface();
+	if (m_connectivity > 0) labelComponents();
+	if (m_tracked > 0) trackPeople();
+	if (m_refine_levels > 0) refineSurface(foregrounds);
+	m_colors_valid = false;
+	m_mesh_valid = false;
+}
+
+/**
+ * The colours of the surface voxels (in the order of getSurfaceVoxels()), coloured
+ * on the first call after an update
+ */
+const vector<Vec3b>& Reconstructor::getVoxelColors()
+{
+	if (!m_colors_valid) colorVoxels();
+	return m_colors;
+}
+
+/**
+ * Get the mesh of the visible voxels, extracted if this update's isn't yet
+ */
+const Mesh& Reconstructor::getMesh()
+{
+	if (!m_mesh_valid) extractMesh();
+	return m_mesh;
+}
+
+/**
+ * Find the visible voxels on the surface: those with a face neighbour that isn't
+ * visible (or on the border of the volume), flagged per visible voxel in m_surface
+ * and listed in the sorted surface_voxels vector
+ * The neighbours are looked up in a bitset of the visible voxels' grid points.
+ */
+void Reconstructor::findSurface()
+{
+	const int visible = (int) m_visible_voxels.size();
+	const int plane = m_plane_x * m_plane_y;
+
+	m_grid_bits.assign(((size_t) plane * m_plane_z + 63) / 64, 0);
+	for (int i = 0; i < visible; ++i)
+	{
+		const int g = m_voxel_ids[m_visible_voxels[i]];
+		m_grid_bits[g / 64] |= (uint64_t) 1 << (g % 64);
+	}
+
+	m_surface.assign(visible, 0);
+	int i;
+#pragma omp parallel for schedule(static) private(i)
+	for (i = 0; i < visible; ++i)
+	{
+		const int g = m_voxel_ids[m_visible_voxels[i]];
+		const int xp = g % m_plane_x, yp = (g / m_plane_x) % m_plane_y, zp = g / plane;
+		if (xp == 0 || yp == 0 || zp == 0 || xp == m_plane_x - 1 || yp == m_plane_y - 1 || zp == m_plane_z - 1)
+		{
+			m_surface[i] = 1;
+			continue;
+		}
+
+		const int neighbours[] = { g - 1, g + 1, g - m_plane_x, g + m_plane_x, g - plane, g + plane };
+		for (int n = 0; n < 6 && !m_surface[i]; ++n)
+			m_surface[i] = !((m_grid_bits[neighbours[n] / 64] >> (neighbours[n] % 64)) & 1);
+	}
+
+	m_surface_voxels.clear();
+	for (i = 0; i < visible; ++i)
+		if (m_surface[i]) m_surface_voxels.push_back(m_visible_voxels[i]);
+}
+
+/**
+ * Colour the surface voxels with the mean colour of their pixels on the cameras
+ * that see them, grey if no camera does; the voxels inside get no colour
+ * Per camera a depth buffer of DEPTH_CELL x DEPTH_CELL pixel cells keeps the distance
+ * of the nearest surface voxel projecting in the cell, a camera sees the voxels within
+ * a voxel diagonal of that.
+ */
+void Reconstructor::colorVoxels()
+{
+	const int cameras = (int) m_cameras.size();
+	const int surface = (int) m_surface_voxels.size();
+	const int width = m_plane_size.width;
+	const int cells_x = (width + DEPTH_CELL - 1) / DEPTH_CELL;
+	const int cells = cells_x * ((m_plane_size.height + DEPTH_CELL - 1) / DEPTH_CELL);
+	const float tolerance = sqrt(3.0f) * m_step;
+
+	vector<vector<float> > depths(cameras);
+	int c;
+#pragma omp parallel for schedule(static) private(c)
+	for (c = 0; c < cameras; ++c)
+	{
+		const int* lut = m_lut_data + c * m_voxels_amount;
+		depths[c].assign(cells, FLT_MAX);
+		for (int i = 0; i < surface; ++i)
+		{
+			const int v = m_surface_voxels[i];
+			const int cell = (lut[v] / width / DEPTH_CELL) * cells_x + (lut[v] % width) / DEPTH_CELL;
+			depths[c][cell] = std::min(depths[c][cell], voxelDistance(c, v));
+		}
+	}
+
+	m_colors.assign(surface, Vec3b(128, 128, 128));
+	int i;
+#pragma omp parallel for schedule(dynamic, 64) private(i)
+	for (i = 0; i < surface; ++i)
+	{
+		const int v = m_surface_voxels[i];
+		int sum[3] = { 0, 0, 0 };
+		int seen = 0;
+		for (int c = 0; c < cameras; ++c)
+		{
+			const int pixel = m_lut_data[c * m_voxels_amount + v];
+			const int cell = (pixel / width / DEPTH_CELL) * cells_x + (pixel % width) / DEPTH_CELL;
+			if (voxelDistance(c, v) > depths[c][cell] + tolerance) continue;
+
+			const Vec3b &color = m_cameras[c]->getFrame().ptr<Vec3b>()[pixel];
+			for (int k = 0; k < 3; ++k)
+				sum[k] += color[k];
+			++seen;
+		}
+
+		if (seen > 0)
+			m_colors[i] = Vec3b((uchar) (sum[0] / seen), (uchar) (sum[1] / seen), (uchar) (sum[2] / seen));
+	}
+
+	m_colors_valid = true;
+}
+
+/**
+ * Label the visible voxels by connected component (6, 18 or 26 connected) with a
+ * union-find over their grid points, in the occupancy bitset of findSurface(), drop
+ * the components of fewer than MinComponentSize voxels and gather the statistics of
+ * the others
+ * The grid is split in blocks of LABEL_BLOCK_PLANES z-planes, in parallel every block
+ * unites its voxels with their neighbours before them (in grid order) in the block;
+ * the neighbours in the block before are united after that. The components are numbered
+ * in the order of the visible voxels.
+ */
+void Reconstructor::labelComponents()
+{
+	const int visible = (int) m_visible_voxels.size();
+	const int plane = m_plane_x * m_plane_y;
+	const int blocks = (m_plane_z + LABEL_BLOCK_PLANES - 1) / LABEL_BLOCK_PLANES;
+	int* parents = &m_label_parents[0];
+
+	// The neighbours before a grid point, at most 1 (faces), 2 (edges) or 3 (corners) steps away
+	const int steps = m_connectivity == 6 ? 1 : m_connectivity == 18 ? 2 : 3;
+	vector<Point3i> neighbours;
+	for (int dz = -1; dz <= 0; ++dz)
+		for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx)
+				if ((dz < 0 || dy < 0 || (dy == 0 && dx < 0)) && abs(dx) + abs(dy) + abs(dz) <= steps)
+					neighbours.push_back(Point3i(dx, dy, dz));
+
+	vector<vector<pair<int, int> > > across(blocks);
+	int b;
+#pragma omp parallel for schedule(dynamic) private(b)
+	for (b = 0; b < blocks; ++b)
+	{
+		const int begin = b * LABEL_BLOCK_PLANES * plane;
+		const int end = std::min(m_plane_z, (b + 1) * LABEL_BLOCK_PLANES) * plane;
+		for (int w = begin / 64; w * 64 < end; ++w)
+		{
+			for (uint64_t bits = m_grid_bits[w]; bits; bits &= bits - 1)
+			{
+				const int g = w * 64 + General::lowestBit(bits);
+				if (g < begin || g >= end) continue;
+
+				parents[g] = g;
+				const int xp = g % m_plane_x, yp = (g / m_plane_x) % m_plane_y, zp = g / plane;
+				for (size_t n = 0; n < neighbours.size(); ++n)
+				{
+					const Point3i &d = neighbours[n];
+					if (xp + d.x < 0 || xp + d.x >= m_plane_x || yp + d.y < 0 || yp + d.y >= m_plane_y || zp + d.z < 0) continue;
+
+					const int neighbour = g + d.x + d.y * m_plane_x + d.z * plane;
+					if (!((m_grid_bits[neighbour / 64] >> (neighbour % 64)) & 1)) continue;
+
+					if (neighbour < begin)
+						across[b].push_back(make_pair(g, neighbour));
+					else
+						uniteRoots(parents, g, neighbour);
+				}
+			}
+		}
+	}
+
+	for (b = 0; b < blocks; ++b)
+		for (size_t p = 0; p < across[b].size(); ++p)
+			uniteRoots(parents, across[b][p].first, across[b][p].second);
+
+	// First the root of every visible voxel
+	m_voxel_labels.resize(visible);
+	int i;
+#pragma omp parallel for schedule(static) private(i)
+	for (i = 0; i < visible; ++i)
+	{
+		int root = m_voxel_ids[m_visible_voxels[i]];
+		while (parents[root] != root)
+			root = parents[root];
+		m_voxel_labels[i] = root;
+	}
+
+	vector<int> sizes;
+	for (i = 0; i < visible; ++i)
+		m_component_ids[m_voxel_labels[i]] = -1;
+	for (i = 0; i < visible; ++i)
+	{
+		int &id = m_component_ids[m_voxel_labels[i]];
+		if (id < 0)
+		{
+			id = (int) sizes.size();
+			sizes.push_back(0);
+		}
+		++sizes[id];
+	}
+
+	// Number the components that are kept
+	m_components.clear();
+	vector<int> kept(sizes.size(), -1);
+	for (size_t k = 0; k < sizes.size(); ++k)
+	{
+		if (sizes[k] < m_min_component_size) continue;
+
+		kept[k] = (int) m_components.size();
+		const Component component = { 0, { INT_MAX, INT_MAX, INT_MAX }, { INT_MIN, INT_MIN, INT_MIN }, Point3f(0, 0, 0) };
+		m_components.push_back(component);
+	}
+
+	for (i = 0; i < visible; ++i)
+	{
+		const int label = kept[m_component_ids[m_voxel_labels[i]]];
+		m_voxel_labels[i] = label;
+		if (label < 0) continue;
+
+		const Voxel voxel = getVoxel(m_visible_voxels[i]);
+		Component &component = m_components[label];
+		++component.voxels;
+		component.min.x = std::min(component.min.x, voxel.x);
+		component.min.y = std::min(component.min.y, voxel.y);
+		component.min.z = std::min(component.min.z, voxel.z);
+		component.max.x = std::max(component.max.x, voxel.x);
+		component.max.y = std::max(component.max.y, voxel.y);
+		component.max.z = std::max(component.max.z, voxel.z);
+		component.centroid += Point3f((float) voxel.x, (float) voxel.y, (float) voxel.z);
+	}
+
+	for (size_t k = 0; k < m_components.size(); ++k)
+		m_components[k].centroid *= 1.0f / m_components[k].voxels;
+}
+
+/**
+ * Track TrackedPeople people on the floor: count the visible voxels per floor cell (grid
+ * column) and cluster the cells, weighted by their counts, with k-means
+ * k-means starts from the last update's track positions, so it takes one or two
+ * iterations while the people move little between updates, and a track keeps its id
+ * as long as there are tracks to start from. Without those (at the start, after a
+ * seek or too few cells) the tracks start over with new ids from the heaviest cell and
+ * each time the cell farthest from the chosen ones.
+ */
+void Reconstructor::trackPeople()
+{
+	const int plane = m_plane_x * m_plane_y;
+
+	for (size_t c = 0; c < m_floor_cells.size(); ++c)
+		m_floor_counts[m_floor_cells[c]] = 0;
+	m_floor_cells.clear();
+	for (size_t i = 0; i < m_visible_voxels.size(); ++i)
+	{
+		const int cell = m_voxel_ids[m_visible_voxels[i]] % plane;
+		if (m_floor_counts[cell]++ == 0) m_floor_cells.push_back(cell);
+	}
+
+	m_track_iterations = 0;
+	const int cells = (int) m_floor_cells.size();
+	if (cells < m_tracked)
+	{
+		m_tracks.clear();
+		return;
+	}
+
+	vector<Point2f> positions(cells);
+	for (int c = 0; c < cells; ++c)
+		positions[c] = Point2f((float) (m_xL + (m_floor_cells[c] % m_plane_x) * m_step),
+				(float) (m_yL + (m_floor_cells[c] / m_plane_x) * m_step));
+
+	if ((int) m_tracks.size() != m_tracked)
+	{
+		m_tracks.clear();
+		vector<float> distances(cells, FLT_MAX);
+		int next = 0;
+		for (int c = 1; c < cells; ++c)
+			if (m_floor_counts[m_floor_cells[c]] > m_floor_counts[m_floor_cells[next]]) next = c;
+
+		for (int t = 0; t < m_tracked; ++t)
+		{
+			const Track track = { m_next_track_id++, positions[next], 0 };
+			m_tracks.push_back(track);
+
+			for (int c = 0; c < cells; ++c)
+			{
+				const Point2f d = positions[c] - track.position;
+				distances[c] = std::min(distances[c], d.dot(d));
+			}
+			next = (int) (std::max_element(distances.begin(), distances.end()) - distances.begin());
+		}
+	}
+
+	m_floor_clusters.assign(cells, -1);
+	for (int iteration = 0; iteration < MAX_TRACK_ITERATIONS; ++iteration)
+	{
+		bool changed = false;
+		for (int c = 0; c < cells; ++c)
+		{
+			int nearest = 0;
+			float nearest_distance = FLT_MAX;
+			for (int t = 0; t < m_tracked; ++t)
+			{
+				const Point2f d = positions[c] - m_tracks[t].position;
+				if (d.dot(d) < nearest_distance)
+				{
+					nearest_distance = d.dot(d);
+					nearest = t;
+				}
+			}
+			changed |= m_floor_clusters[c] != nearest;
+			m_floor_clusters[c] = nearest;
+		}
+		if (!changed) break;
+
+		vector<Point2f> sums(m_tracked, Point2f(0, 0));
+		vector<int> voxels(m_tracked, 0);
+		for (int c = 0; c < cells; ++c)
+		{
+			const int count = m_floor_counts[m_floor_cells[c]];
+			sums[m_floor_clusters[c]] += positions[c] * (float) count;
+			voxels[m_floor_clusters[c]] += count;
+		}
+
+		// A track without cells stays where it was
+		for (int t = 0; t < m_tracked; ++t)
+		{
+			m_tracks[t].voxels = voxels[t];
+			if (voxels[t] > 0) m_tracks[t].position = sums[t] * (1.0f / voxels[t]);
+		}
+		++m_track_iterations;
+	}
+}
+
+/**
+ * Extract the mesh of the visible voxels with marching cubes
+ * The occupancy (1 on the visible voxels) is laid out on their bounding box, padded
+ * to stay empty on its border, smoothed by MeshSmoothing passes of a [1 2 1] / 4 filter
+ * along x, y and z and cut at 0.5. Smoothing rounds the blocky surface off, but parts
+ * that are one voxel thin disappear.
+ */
+void Reconstructor::extractMesh()
+{
+	const int64 start = getTickCount();
+	m_mesh_valid = true;
+	m_mesh.vertices.clear();
+	m_mesh.triangles.clear();
+	m_mesh_time = 0;
+	if (m_visible_voxels.empty()) return;
+
+	const int pad = 1 + m_mesh_smoothing;
+	const int x0 = m_visible_box.x0 - pad, y0 = m_visible_box.y0 - pad, z0 = m_visible_box.z0 - pad;
+	const int nx = m_visible_box.x1 - x0 + 1 + pad;
+	const int ny = m_visible_box.y1 - y0 + 1 + pad;
+	const int nz = m_visible_box.z1 - z0 + 1 + pad;
+	const int plane = m_plane_x * m_plane_y;
+
+	m_mesh_field.assign((size_t) nx * ny * nz, 0.0f);
+	for (size_t i = 0; i < m_visible_voxels.size(); ++i)
+	{
+		const int g = m_voxel_ids[m_visible_voxels[i]];
+		const int xp = g % m_plane_x, yp = (g % plane) / m_plane_x, zp = g / plane;
+		m_mesh_field[((size_t) (zp - z0) * ny + (yp - y0)) * nx + (xp - x0)] = 1.0f;
+	}
+
+	m_mesh_buffer.resize(m_mesh_field.size());
+	for (int p = 0; p < m_mesh_smoothing; ++p)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const int size = axis == 0 ? nx : axis == 1 ? ny : nz;
+			const size_t stride = axis == 0 ? 1 : axis == 1 ? nx : (size_t) nx * ny;
+			const float* in = &m_mesh_field[0];
+			float* out = &m_mesh_buffer[0];
+
+			int z;
+#pragma omp parallel for schedule(static) private(z)
+			for (z = 0; z < nz; ++z)
+			{
+				for (int y = 0; y < ny; ++y)
+				{
+					for (int x = 0; x < nx; ++x)
+					{
+						const size_t i = ((size_t) z * ny + y) * nx + x;
+						const int at = axis == 0 ? x : axis == 1 ? y : z;
+						const float before = at > 0 ? in[i - stride] : 0.0f;
+						const float after = at + 1 < size ? in[i + stride] : 0.0f;
+						out[i] = (before + 2 * in[i] + after) * 0.25f;
+					}
+				}
+			}
+			m_mesh_field.swap(m_mesh_buffer);
+		}
+	}
+
+	const Point3f origin((float) (m_xL + x0 * m_step), (float) (m_yL + y0 * m_step), (float) (m_zL + z0 * m_step));
+	m_marching_cubes.extract(m_mesh_field, Size(nx, ny), nz, 0.5f, origin, (float) m_step, m_mesh);
+	m_mesh_time = (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+/**
+ * Refine the surface voxels: split each into 2^levels children along each axis and
+ * keep the children that project on foreground in all cameras
+ * The visible voxels inside and the children form a voxel set of mixed resolution.
+ * The children's pixels are projected when a voxel first reaches the surface and then
+ * cached as far as the cache (the LUT's size) holds them, the children of the others are
+ * projected again every update, REFINE_CHUNK voxels at a time. The cache starts over when
+ * new voxels don't fit while most of it belongs to voxels that left the surface.
+ */
+void Reconstructor::refineSurface(
+		const std::vector<const uint64_t*> &foregrounds)
+{
+	const int cameras = (int) m_cameras.size();
+	const int visible = (int) m_visible_voxels.size();
+	const int factor = 1 << m_refine_levels;
+	const int children = factor * factor * factor;
+	const size_t block = (size_t) children * cameras;
+	const size_t capacity = m_lut_bytes / sizeof(int) / block;  // Voxels the cache holds
+
+	size_t surface = 0;
+	vector<int> uncached;
+	for (int i = 0; i < visible; ++i)
+	{
+		if (!m_surface[i]) continue;
+		++surface;
+		if (m_child_offsets[m_visible_voxels[i]] < 0) uncached.push_back(m_visible_voxels[i]);
+	}
+
+	const size_t cached = m_child_lut.size() / block;
+	if (cached + uncached.size() > capacity && 2 * (surface - uncached.size()) < cached)
+	{
+		m_child_offsets.assign(m_voxels_amount, -1);
+		m_child_lut.clear();
+		uncached.clear();
+		for (int i = 0; i < visible; ++i)
+			if (m_surface[i]) uncached.push_back(m_visible_voxels[i]);
+	}
+
+	const size_t fits = std::min(uncached.size(), capacity - m_child_lut.size() / block);
+	for (size_t j = 0; j < fits; ++j)
+		m_child_offsets[uncached[j]] = (int) (m_child_lut.size() + j * block);
+	projectChildren(vector<int>(uncached.begin(), uncached.begin() + fits), m_child_lut);
+
+	// Bit k of a surface voxel's mask is set if child k is present on all cameras
+	vector<uint64_t> present(visible, 0);
+	int i;
+#pragma omp parallel for schedule(dynamic, 64) private(i)
+	for (i = 0; i < visible; ++i)
+	{
+		const int offset = m_surface[i] ? m_child_offsets[m_visible_voxels[i]] : -1;
+		if (offset >= 0) present[i] = presentChildren(&m_child_lut[offset], children, foregrounds);
+	}
+
+	// The children of the surface voxels that didn't fit
+	vector<int> overflow;
+	for (int i = 0; i < visible; ++i)
+		if (m_surface[i] && m_child_offsets[m_visible_voxels[i]] < 0) overflow.push_back(i);
+
+	for (size_t begin = 0; begin < overflow.size(); begin += REFINE_CHUNK)
+	{
+		const int amount = (int) std::min(overflow.size() - begin, (size_t) REFINE_CHUNK);
+		vector<int> voxels(amount);
+		for (int j = 0; j < amount; ++j)
+			voxels[j] = m_visible_voxels[overflow[begin + j]];
+
+		m_child_scratch.clear();
+		projectChildren(voxels, m_child_scratch);
+
+		int j;
+#pragma omp parallel for schedule(dynamic, 64) private(j)
+		for (j = 0; j < amount; ++j)
+			present[overflow[begin + j]] = presentChildren(&m_child_scratch[j * block], children, foregrounds);
+	}
+
+	m_refined_voxels.clear();
+	for (int i = 0; i < visible; ++i)
+	{
+		if (!present[i]) continue;
+
+		const Voxel voxel = getVoxel(m_visible_voxels[i]);
+		for (uint64_t bits = present[i]; bits; bits &= bits - 1)
+		{
+			const int k = General::lowestBit(bits);
+			Voxel child;
+			child.x = voxel.x + childOffset(k % factor);
+			child.y = voxel.y + childOffset(k / factor % factor);
+			child.z = voxel.z + childOffset(k / factor / factor);
+			m_refined_voxels.push_back(child);
+		}
+	}
+}
+
+/**
+ * Offset of the center of the i-th child along an axis from its voxel's center
+ */
+int Reconstructor::childOffset(
+		int i) const
+{
+	const int factor = 1 << m_refine_levels;
+	return cvRound((i + 0.5) * m_step / factor - m_step / 2.0);
+}
+
+/**
+ * Project the children of the voxels on every camera into new blocks at the end of the
+ * given child LUT
+ */
+void Reconstructor::projectChildren(
+		const vector<int> &voxels, vector<int> &child_lut) const
+{
+	if (voxels.empty()) return;
+
+	const int cameras = (int) m_cameras.size();
+	const int factor = 1 << m_refine_levels;
+	const int children = factor * factor * factor;
+	const size_t first = child_lut.size();
+
+	vector<Point3f> centers;
+	for (size_t j = 0; j < voxels.size(); ++j)
+	{
+		const Voxel voxel = getVoxel(voxels[j]);
+		for (int k = 0; k < children; ++k)
+			centers.push_back(Point3f((float) (voxel.x + childOffset(k % factor)), (float) (voxel.y + childOffset(k / factor % factor)),
+					(float) (voxel.z + childOffset(k / factor / factor))));
+	}
+	child_lut.resize(first + centers.size() * cameras);
+
+	int c;
+#pragma omp parallel for schedule(static) private(c)
+	for (c = 0; c < cameras; ++c)
+	{
+		vector<Point2f> points;
+		m_cameras[c]->projectOnView(centers, points);
+		for (size_t p = 0; p < points.size(); ++p)
+		{
+			const Point point(cvRound(points[p].x), cvRound(points[p].y));
+			const bool inside = point.x >= 0 && point.x < m_plane_size.width && point.y >= 0 && point.y < m_plane_size.height;
+			child_lut[first + p * cameras + c] = inside ? point.y * m_plane_size.width + point.x : INVALID_PIXEL;
+		}
+	}
+}
+
+/**
+ * Distance of the voxel to the camera
+ */
+float Reconstructor::voxelDistance(
+		int camera, int index) const
+{
+	const Voxel voxel = getVoxel(index);
+	return (float) norm(Point3f((float) voxel.x, (float) voxel.y, (float) voxel.z) - m_cameras[camera]->getCameraLocation());
+}
+
+/**
+ * Get the world coordinates of the voxel at the given index
+ */
+Reconstructor::Voxel Reconstructor::getVoxel(
+		int voxel_index) const
+{
+	const int index = m_voxel_ids[voxel_index];
+	const int plane = m_plane_x * m_plane_y;
+	const int zp = index / plane;
+	const int yp = (index % plane) / m_plane_x;
+	const int xp = index % m_plane_x;
+
+	Voxel voxel;
+	voxel.x = m_xL + xp * m_step;
+	voxel.y = m_yL + yp * m_step;
+	voxel.z = m_zL + zp * m_step;
+	return voxel;
+}
+
+/**
+ * Get the voxel at the given grid index, or -1 if that grid point isn't a voxel
+ */
+int Reconstructor::getVoxelIndex(
+		int grid_index) const
+{
+	if (m_voxel_order != LINEAR) return m_grid_voxels[grid_index];
 
-	m_visible_voxels.insert(m_visible_voxels.end(), visible_voxels.begin(), visible_voxels.end());
+	const vector<int>::const_iterator it = std::lower_bound(m_voxel_ids.begin(), m_voxel_ids.end(), grid_index);
+	return it != m_voxel_ids.end() && *it == grid_index ? (int) (it - m_voxel_ids.begin()) : -1;
 }
 
 } /* namespace nl_uu_science_gmt */
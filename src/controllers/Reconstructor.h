@@ -10,8 +10,13 @@
 
 #include <opencv2/core/core.hpp>
 #include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
 #include <vector>
 
+#include "../utilities/MappedFile.h"
+#include "../utilities/MarchingCubes.h"
 #include "Camera.h"
 
 namespace nl_uu_science_gmt
@@ -27,53 +32,380 @@ public:
 	struct Voxel
 	{
 		int x, y, z;                               // Coordinates
-		cv::Scalar color;                          // Color
-		std::vector<cv::Point> camera_projection;  // Projection location for camera[c]'s FoV (2D)
-		std::vector<int> valid_camera_projection;  // Flag if camera projection is in camera[c]'s FoV
 	};
 
+	/*
+	 * Carving statistics of a camera
+	 */
+	struct CameraStats
+	{
+		size_t tested;                             // Voxels tested on the camera
+		size_t rejected;                           // Voxels rejected by the camera
+		size_t sampled;                            // Voxels in the sample words, which are tested on all cameras
+		size_t sample_rejected;                    // Sampled voxels rejected by the camera
+	};
+
+	/*
+	 * Region of the voxel space: a floor polygon extruded from z0 up to z1
+	 */
+	struct Region
+	{
+		std::vector<cv::Point2f> floor;            // Floor polygon (mm)
+		int z0, z1;                                // Height range (mm)
+	};
+
+	/*
+	 * Connected component of the visible voxels
+	 */
+	struct Component
+	{
+		int voxels;                                // Number of voxels
+		Voxel min, max;                            // Bounding box of the voxels (mm)
+		cv::Point3f centroid;                      // Mean of the voxels (mm)
+	};
+
+	/*
+	 * Person tracked on the floor
+	 */
+	struct Track
+	{
+		int id;                                    // Stays the same from update to update
+		cv::Point2f position;                      // Centre of the person's floor cells (mm)
+		int voxels;                                // Number of voxels of the person
+	};
+
+	/*
+	 * Order of the voxels in the LUT, the bitsets and the visible voxels
+	 */
+	enum VoxelOrder
+	{
+		LINEAR,                                    // Grid order: z, then y, then x
+		MORTON,                                    // Z-order curve through the grid
+		BRICKS                                     // Bricks of BRICK_SIZE^3 in grid order, linear inside a brick
+	};
+
+	static const int INVALID_PIXEL = -1;       // LUT sentinel: voxel projects outside the camera's FoV
+	static const int CHUNK_WORDS = 64;         // Words (of 64 voxels) per chunk of work in update()
+	static const int NODE_LEVELS = 4;          // Carving hierarchy levels, a node on level l spans 8^l words
+	static const int SAMPLE_WORDS = 16;        // Every 16th carved word is tested on all cameras to rank them
+	static const int ROI_PADDING = 2;          // Pixels around the foreground boxes that are back projected into the ROI
+	static const int BRICK_SIZE = 4;           // Grid points along each axis of a brick in the BRICKS order
+	static const int DEPTH_CELL = 8;           // Pixels along each side of a depth buffer cell when colouring
+	static const int MAX_REFINE_LEVELS = 2;    // Surface refinement levels, a surface voxel has at most 64 children
+	static const int REFINE_CHUNK = 4096;      // Surface voxels per projection when their children don't fit the cache
+	static const int LABEL_BLOCK_PLANES = 8;   // Grid z-planes per block of the connected component labelling
+	static const int MAX_TRACK_ITERATIONS = 10;  // k-means iterations per update when tracking
+
 private:
+	/*
+	 * Pixel rectangle [x0, x1] x [y0, y1], empty if x0 > x1
+	 */
+	struct PixelRect
+	{
+		short x0, y0, x1, y1;
+	};
+
+	/*
+	 * Box [x0, x1] x [y0, y1] x [z0, z1] in voxel coordinates, empty if x0 > x1
+	 */
+	struct VoxelBox
+	{
+		int x0, y0, z0, x1, y1, z1;
+	};
+
 	const std::vector<Camera*> &m_cameras;  // vector of pointers to cameras
-	const int m_height;                     // Cube half-space height from floor to ceiling
-	const int m_step;                       // Step size (space between voxels)
+	int m_step;                             // Step size (space between voxels)
 
 	std::vector<cv::Point3f*> m_corners;    // Cube half-space corner locations
 
 	size_t m_voxels_amount;                 // Voxel count
+	size_t m_lut_bytes;                     // LUT size in bytes
 	cv::Size m_plane_size;                  // Camera FoV plane WxH
 
-	std::vector<Voxel*> m_voxels;           // Pointer vector to all voxels in the half-space
-	std::vector<Voxel*> m_visible_voxels;   // Pointer vector to all visible voxels
+	int m_xL, m_xR;                         // Volume bounds along the x axis
+	int m_yL, m_yR;                         // Volume bounds along the y axis
+	int m_zL, m_zR;                         // Volume bounds along the z axis
+	int m_plane_x, m_plane_y, m_plane_z;    // Grid points along the x, y and z axis
+	bool m_shrink_volume;                   // Shrink the volume bounds to the grid points in view of all cameras
+	std::vector<Region> m_regions;          // Regions that confine the voxels, none leaves the whole volume
+
+	/*
+	 * The voxels are the grid points in view of all cameras (and in a region), in the voxel
+	 * order. Voxel v is grid point m_voxel_ids[v], (zp * m_plane_y + yp) * m_plane_x + xp.
+	 */
+	VoxelOrder m_voxel_order;
+	std::vector<int> m_voxel_ids;
+	std::vector<int> m_row_voxels;          // LINEAR: first voxel of each row of grid points along the x axis, and the voxel count
+	std::vector<int> m_grid_voxels;         // Other orders: voxel of each grid point, or -1
+
+	/*
+	 * Voxel to camera pixel LUT, one packed block of m_voxels_amount entries per camera.
+	 * Entry [c * m_voxels_amount + v] is the linear pixel offset (y * width + x) of
+	 * voxel v on camera c, or INVALID_PIXEL if it falls outside camera c's FoV.
+	 */
+	std::vector<int> m_lut;                 // LUT storage when it isn't mapped from the cache file
+	MappedFile m_lut_file;                  // LUT cache file mapping
+	const int* m_lut_data;                  // The LUT (in m_lut or m_lut_file)
+
+	/*
+	 * Voxel footprints, the half width and height in pixels of the projection of voxel v on
+	 * camera c are entries [2 * (c * m_voxels_amount + v)] and [2 * (c * m_voxels_amount + v) + 1]
+	 */
+	float m_footprint_fill;                 // Fraction of a voxel's footprint that must be foreground, 0 tests its center pixel
+	std::vector<uint8_t> m_footprints;      // Footprint storage when it isn't mapped from the cache file
+	const uint8_t* m_footprint_data;        // The footprints (in m_footprints or m_lut_file)
+	std::vector<int> m_footprint_margins;   // Per camera the largest half extent of a footprint
+	std::vector<cv::Mat> m_integrals;       // Per camera the integral image of the foreground
+
+	/*
+	 * Carving hierarchy, node n on level l spans words [n * 8^l, (n + 1) * 8^l).
+	 * Entry [l][n * cameras + c] bounds the pixels of the node's voxels on camera c.
+	 * The nodes are ranges in voxel order: compact cells in the MORTON and BRICKS
+	 * orders, but slabs of grid rows in the LINEAR order.
+	 */
+	std::vector<std::vector<PixelRect> > m_node_rects;
+	bool m_hierarchical;                    // Carve coarse to fine through the hierarchy
+
+	/*
+	 * Pixel to voxel index (CSR), the inverse of the LUT. On camera c the voxels projecting
+	 * on pixel p are m_pixel_voxels[c][m_pixel_offsets[c][p] .. m_pixel_offsets[c][p + 1]).
+	 */
+	std::vector<std::vector<int> > m_pixel_offsets;
+	std::vector<std::vector<int> > m_pixel_voxels;
+
+	float m_vote_density;                   // Accumulate votes pixel by pixel below this fraction of foreground pixels
+	bool m_incremental;                     // Carve only the voxels on pixels that changed since the last update, before any other carve
+	bool m_votes_valid;                     // m_votes and m_previous_foregrounds hold the last update's state
+	std::vector<uint8_t> m_votes;           // Per voxel amount of cameras on which it projects on foreground
+	std::vector<std::vector<uint64_t> > m_previous_foregrounds;  // Each camera's foreground bits of the last update
+
+	bool m_simd;                            // Carve words with the AVX2 kernel
+
+	typedef uint64_t (Reconstructor::*CarveWordKernel)(int, const std::vector<const uint64_t*> &, CameraStats*) const;
+	CarveWordKernel m_carve_word;           // Word carving kernel for the amount of cameras
+
+	bool m_roi_culling;                     // Carve only the region back projected from the foreground boxes
+	std::vector<int> m_roi_cameras;         // Cameras that can bound the region (the volume is in front of them)
+	std::vector<uint64_t> m_roi_bits;       // Bitset of the voxels in the region of interest
+
+	int m_max_velocity;                     // Maximum speed of the people (mm per frame), 0 doesn't predict the region
+	float m_prediction_outside;             // Fraction of the foreground outside the predicted region that falls back to a full carve
+	VoxelBox m_visible_box;                 // Bounding box of the last update's visible voxels
+	bool m_prediction_valid;                // The last update's visible voxels predict this update's (no seek in between)
+	bool m_predicted;                       // The last update carved only the predicted region
+	std::vector<CameraStats> m_camera_stats;  // Per camera carving statistics of the last update
+	std::vector<int> m_camera_order;        // Cameras in the order a voxel is tested on them
+
+	std::vector<uint64_t> m_visible_bits;   // Bitset of the visible voxels, voxel v is bit (v % 64) of word (v / 64)
+	std::vector<int> m_visible_voxels;      // Indices of all visible voxels (ascending)
 
+	bool m_coloring;                        // Colour the visible voxels, when the colours are asked for
+	bool m_colors_valid;                    // m_colors holds the colours of the last update's surface voxels
+	std::vector<uint64_t> m_grid_bits;      // Bitset of the grid points of the visible voxels
+	std::vector<char> m_surface;            // Per visible voxel whether it's on the surface
+	std::vector<int> m_surface_voxels;      // Sorted voxel indices of the visible voxels on the surface
+	std::vector<cv::Vec3b> m_colors;        // Per surface voxel its colour (BGR)
+
+	/*
+	 * Surface refinement, the children of voxel v have their pixels in the child LUT from
+	 * m_child_offsets[v] on, child k's pixel on camera c at [k * cameras + c]
+	 * The cache holds at most the LUT's size, the children of the surface voxels that don't
+	 * fit are projected into the scratch buffer REFINE_CHUNK voxels at a time
+	 */
+	int m_refine_levels;                    // Halvings of the step for the surface voxels, 0 doesn't refine
+	std::vector<int> m_child_offsets;       // Per voxel its children's block in m_child_lut, or -1 if not projected yet
+	std::vector<int> m_child_lut;           // Child pixel offsets, or INVALID_PIXEL
+	std::vector<int> m_child_scratch;       // Child pixel offsets of the surface voxels that aren't cached
+	std::vector<Voxel> m_refined_voxels;    // Children of the surface voxels that are present on all cameras
+
+	int m_mesh_smoothing;                   // Smoothing passes over the occupancy before meshing
+	bool m_mesh_valid;                      // m_mesh holds the mesh of the last update's visible voxels
+	std::vector<float> m_mesh_field;        // Occupancy on the visible voxels' bounding box (padded)
+	std::vector<float> m_mesh_buffer;       // Smoothing pass output
+	MarchingCubes m_marching_cubes;
+	Mesh m_mesh;
+	double m_mesh_time;                     // Milliseconds the last mesh extraction took
+
+	int m_connectivity;                     // Neighbours (6, 18 or 26) connecting the voxels of a component, 0 doesn't label
+	int m_min_component_size;               // Components of fewer voxels are dropped
+	std::vector<int> m_label_parents;       // Per grid point of a visible voxel its union-find parent (grid index)
+	std::vector<int> m_component_ids;       // Per union-find root grid point its component, while labelling
+	std::vector<int> m_voxel_labels;        // Per visible voxel its component, or -1 if it's dropped
+	std::vector<Component> m_components;    // The components of the last update
+
+	int m_tracked;                          // People tracked on the floor, 0 doesn't track
+	int m_next_track_id;                    // Id of the next new track
+	int m_track_iterations;                 // k-means iterations of the last update
+	std::vector<int> m_floor_counts;        // Per floor cell (grid column) its visible voxels
+	std::vector<int> m_floor_cells;         // Floor cells with visible voxels
+	std::vector<int> m_floor_clusters;      // Per floor cell with visible voxels its track
+	std::vector<Track> m_tracks;            // The tracks of the last update
+
+	void readRegions(const cv::FileNode &, const std::string &);
+	bool setStep(int);
+	size_t memoryRequired() const;
 	void initialize();
+	void pruneLut();
+	uint64_t orderKey(int) const;
+	void initFootprints();
+	void initHierarchy();
+	void initPixelIndex();
+	void initKernels();
+	void initRoi();
+	void computeRoi();
+	bool isRoiEmpty(int, int) const;
+	bool predictRegion(VoxelBox &) const;
+	cv::Rect projectBox(const Camera*, const VoxelBox &) const;
+	void boundVisible();
+
+	uint64_t carveWord(int, const std::vector<const uint64_t*> &, CameraStats*) const;
+	template<int CAMERAS>
+	uint64_t carveWordFixed(int, const std::vector<const uint64_t*> &, CameraStats*) const;
+	uint64_t presentFootprints(int, int, uint64_t) const;
+	void carveDense(const std::vector<const uint64_t*> &);
+	void carveHierarchical(const std::vector<const uint64_t*> &);
+	void carveNode(int, int, const std::vector<const uint64_t*> &, CameraStats*);
+	void addStats(const std::vector<CameraStats> &);
+	void rankCameras();
+	void carveIncremental(const std::vector<const uint64_t*> &);
+	void countVotes(const std::vector<const uint64_t*> &);
+	void accumulateVotes(const std::vector<const uint64_t*> &);
+	bool isSparse(const std::vector<const uint64_t*> &) const;
+	bool hasPixelIndex() const;
+	void compactVisible();
+	void findSurface();
+	void colorVoxels();
+	void refineSurface(const std::vector<const uint64_t*> &);
+	void extractMesh();
+	void labelComponents();
+	void trackPeople();
+	void projectChildren(const std::vector<int> &, std::vector<int> &) const;
+	int childOffset(int) const;
+	float voxelDistance(int, int) const;
+
+	uint64_t lutKey() const;
+	bool loadLut(const std::string &, uint64_t);
+	bool saveLut(const std::string &, uint64_t) const;
 
 public:
 	Reconstructor(
-			const std::vector<Camera*> &);
+			const std::vector<Camera*> &, const std::string & = "");
 	virtual ~Reconstructor();
 
 	void update();
 
-	const std::vector<Voxel*>& getVisibleVoxels() const
+	Voxel getVoxel(
+			int) const;
+
+	VoxelOrder getVoxelOrder() const
+	{
+		return m_voxel_order;
+	}
+
+	/*
+	 * Grid index (zp * plane y + yp) * plane x + xp of the voxel
+	 */
+	int getGridIndex(
+			int voxel) const
+	{
+		return m_voxel_ids[voxel];
+	}
+
+	int getVoxelIndex(
+			int) const;
+
+	const std::vector<int>& getVisibleVoxels() const
 	{
 		return m_visible_voxels;
 	}
 
-	const std::vector<Voxel*>& getVoxels() const
+	int getRefineLevels() const
+	{
+		return m_refine_levels;
+	}
+
+	/*
+	 * Per visible voxel whether it has a face neighbour that isn't visible
+	 */
+	const std::vector<char>& getSurface() const
 	{
-		return m_voxels;
+		return m_surface;
 	}
 
-	void setVisibleVoxels(
-			const std::vector<Voxel*>& visibleVoxels)
+	const std::vector<int>& getSurfaceVoxels() const
 	{
-		m_visible_voxels = visibleVoxels;
+		return m_surface_voxels;
 	}
 
-	void setVoxels(
-			const std::vector<Voxel*>& voxels)
+	/*
+	 * The children (of step / 2^levels) of the surface voxels that are present on all cameras,
+	 * with the visible voxels that aren't on the surface they form the refined voxel set
+	 */
+	const std::vector<Voxel>& getRefinedVoxels() const
+	{
+		return m_refined_voxels;
+	}
+
+	bool isColoring() const
+	{
+		return m_coloring;
+	}
+
+	const std::vector<cv::Vec3b>& getVoxelColors();
+	const Mesh& getMesh();
+
+	double getMeshTime() const
 	{
-		m_voxels = voxels;
+		return m_mesh_time;
+	}
+
+	int getConnectivity() const
+	{
+		return m_connectivity;
+	}
+
+	/*
+	 * Per visible voxel the index of its component, or -1 if its component is too small
+	 */
+	const std::vector<int>& getVoxelLabels() const
+	{
+		return m_voxel_labels;
+	}
+
+	const std::vector<Component>& getComponents() const
+	{
+		return m_components;
+	}
+
+	int getTracked() const
+	{
+		return m_tracked;
+	}
+
+	const std::vector<Track>& getTracks() const
+	{
+		return m_tracks;
+	}
+
+	int getTrackIterations() const
+	{
+		return m_track_iterations;
+	}
+
+	const std::vector<uint64_t>& getVisibleBits() const
+	{
+		return m_visible_bits;
+	}
+
+	size_t getVoxelsAmount() const
+	{
+		return m_voxels_amount;
+	}
+
+	const int* getLut(
+			size_t camera) const
+	{
+		return m_lut_data + camera * m_voxels_amount;
 	}
 
 	const std::vector<cv::Point3f*>& getCorners() const
@@ -81,9 +413,117 @@ public:
 		return m_corners;
 	}
 
+	const std::vector<Region>& getRegions() const
+	{
+		return m_regions;
+	}
+
+	/*
+	 * Half the floor size of the volume, measured from the origin
+	 */
 	int getSize() const
 	{
-		return m_height;
+		return std::max(std::max(-m_xL, m_xR), std::max(-m_yL, m_yR));
+	}
+
+	int getStep() const
+	{
+		return m_step;
+	}
+
+	bool isHierarchical() const
+	{
+		return m_hierarchical;
+	}
+
+	void setHierarchical(
+			bool hierarchical)
+	{
+		m_hierarchical = hierarchical;
+	}
+
+	float getVoteDensity() const
+	{
+		return m_vote_density;
+	}
+
+	void setVoteDensity(
+			float density)
+	{
+		m_vote_density = density;
+	}
+
+	bool isIncremental() const
+	{
+		return m_incremental;
+	}
+
+	void setIncremental(
+			bool);
+
+	bool isRoiCulling() const
+	{
+		return m_roi_culling;
+	}
+
+	void setRoiCulling(
+			bool roi_culling)
+	{
+		m_roi_culling = roi_culling;
+	}
+
+	const std::vector<uint64_t>& getRoiBits() const
+	{
+		return m_roi_bits;
+	}
+
+	int getMaxVelocity() const
+	{
+		return m_max_velocity;
+	}
+
+	void setMaxVelocity(
+			int max_velocity)
+	{
+		m_max_velocity = max_velocity;
+	}
+
+	bool isPredicted() const
+	{
+		return m_predicted;
+	}
+
+	/*
+	 * The frames aren't consecutive (after a seek): don't predict the next update's region
+	 * from this one's, and start the tracks over
+	 */
+	void resetPrediction()
+	{
+		m_prediction_valid = false;
+		m_tracks.clear();
+	}
+
+	float getFootprintFill() const
+	{
+		return m_footprint_fill;
+	}
+
+	bool isSimd() const
+	{
+		return m_simd;
+	}
+
+	void setSimd(
+			bool);
+
+	const std::vector<CameraStats>& getCameraStats() const
+	{
+		return m_camera_stats;
+	}
+
+	const std::vector<int>& getCameraOrder() const
+	{
+		return m_camera_order;
 	}
 
 	const cv::Size& getPlaneSize() const
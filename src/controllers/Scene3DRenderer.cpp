@@ -45,6 +45,7 @@ Scene3DRenderer::Scene3DRenderer(
 	m_show_org = true;
 	m_show_arcball = false;
 	m_show_info = true;
+	m_show_mesh = false;
 	m_fullscreen = false;
 
 	// Read the checkerboard properties (XML)
@@ -113,6 +114,10 @@ bool Scene3DRenderer::processFrame()
 		assert(m_cameras[c] != NULL);
 		processForeground(m_cameras[c]);
 	}
+
+	// After a seek the last reconstruction says nothing about this frame's
+	if (m_current_frame != m_previous_frame + 1 && m_current_frame != m_previous_frame) m_reconstructor.resetPrediction();
+
 	return true;
 }
 
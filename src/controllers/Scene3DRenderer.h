@@ -50,6 +50,7 @@ class Scene3DRenderer
 	bool m_show_org;                          // flag draw origin into scene
 	bool m_show_arcball;                      // flag make arcball visible in scene
 	bool m_show_info;                         // flag draw information (text) into scene
+	bool m_show_mesh;                         // flag draw the mesh instead of the voxels
 	bool m_fullscreen;                        // flag GL is full screen
 
 	bool m_quit;                              // flag status is quit next iteration
@@ -174,6 +175,17 @@ public:
 		m_show_org = showOrg;
 	}
 
+	bool isShowMesh() const
+	{
+		return m_show_mesh;
+	}
+
+	void setShowMesh(
+			bool showMesh)
+	{
+		m_show_mesh = showMesh;
+	}
+
 	bool isShowVolume() const
 	{
 		return m_show_volume;
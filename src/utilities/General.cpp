@@ -23,6 +23,9 @@ const string General::IntrinsicsFile       = "intrinsics.xml";
 const string General::CheckerboadCorners   = "boardcorners.xml";
 const string General::ConfigFile           = "config.xml";
 const string General::BackgroundVideoFile  = "background.avi";
+const string General::VoxelLutFile         = "voxels.lut";
+const string General::VoxelConfigFile      = "voxels.xml";
+const string General::MeshFile             = "mesh";
 
 /**
  * Linux/Windows friendly way to check if a file exists
@@ -33,4 +36,27 @@ bool General::fexists(const std::string &filename)
 	return ifile.is_open();
 }
 
+/**
+ * Whether the CPU and the OS support AVX2
+ */
+bool General::hasAvx2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) return false;
+
+	// OSXSAVE and AVX, and the OS saves the YMM registers
+	__cpuid(info, 1);
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6) return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+
 } /* namespace nl_uu_science_gmt */
@@ -10,7 +10,11 @@
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/core/operations.hpp>
+#include <stdint.h>
 #include <string>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #define PATH_SEP "/"
 
@@ -44,8 +48,38 @@ public:
 	static const std::string BackgroundImageFile;
 	static const std::string ConfigFile;
 	static const std::string BackgroundVideoFile;
+	static const std::string VoxelLutFile;
+	static const std::string VoxelConfigFile;
+	static const std::string MeshFile;
 
 	static bool fexists(const std::string&);
+	static bool hasAvx2();
+
+	/**
+	 * Number of set bits in the given word
+	 */
+	static inline int bitCount(uint64_t word)
+	{
+#ifdef _MSC_VER
+		return (int) __popcnt64(word);
+#else
+		return __builtin_popcountll(word);
+#endif
+	}
+
+	/**
+	 * Index of the lowest set bit in the given (non-zero) word
+	 */
+	static inline int lowestBit(uint64_t word)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, word);
+		return (int) index;
+#else
+		return __builtin_ctzll(word);
+#endif
+	}
 };
 
 } /* namespace nl_uu_science_gmt */
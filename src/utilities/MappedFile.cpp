@@ -0,0 +1,146 @@
+/*
+ * MappedFile.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <sstream>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace nl_uu_science_gmt
+{
+
+MappedFile::MappedFile() :
+		m_data(NULL),
+		m_size(0)
+{
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+/**
+ * Map the given file into memory (read-only)
+ */
+bool MappedFile::open(
+		const string &filename)
+{
+	close();
+
+#ifdef _WIN32
+	// Shared for deletion, so another process can replace the file while it's mapped
+	m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		close();
+		return false;
+	}
+
+	m_data = MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+	if (m_data == NULL)
+	{
+		close();
+		return false;
+	}
+	m_size = (size_t) size.QuadPart;
+#else
+	const int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	// The mapping stays valid after closing the descriptor
+	void* data = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) return false;
+
+	m_data = data;
+	m_size = (size_t) st.st_size;
+#endif
+
+	return true;
+}
+
+/**
+ * Unmap the file
+ */
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (m_data != NULL) UnmapViewOfFile(m_data);
+	if (m_mapping != NULL) CloseHandle(m_mapping);
+	if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+	m_mapping = NULL;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data != NULL) munmap(const_cast<void*>(m_data), m_size);
+#endif
+
+	m_data = NULL;
+	m_size = 0;
+}
+
+/**
+ * A name next to the given file to write it aside under, unique per process
+ */
+string MappedFile::tempName(
+		const string &filename)
+{
+	stringstream name;
+#ifdef _WIN32
+	name << filename << "." << GetCurrentProcessId() << ".tmp";
+#else
+	name << filename << "." << getpid() << ".tmp";
+#endif
+	return name.str();
+}
+
+/**
+ * Move a file over another one in a single step, processes that have the
+ * replaced file mapped keep their mapping
+ */
+bool MappedFile::replace(
+		const string &from, const string &to)
+{
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+} /* namespace nl_uu_science_gmt */
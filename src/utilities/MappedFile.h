@@ -0,0 +1,61 @@
+/*
+ * MappedFile.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <stddef.h>
+#include <string>
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Read-only memory mapping of a whole file
+ * Processes that map the same file share its physical pages
+ */
+class MappedFile
+{
+	const void* m_data;          // Start of the mapped file contents
+	size_t m_size;               // Mapped size in bytes
+
+#ifdef _WIN32
+	void* m_file;                // File handle
+	void* m_mapping;             // File mapping handle
+#endif
+
+	MappedFile(const MappedFile &);
+	MappedFile& operator=(const MappedFile &);
+
+public:
+	MappedFile();
+	virtual ~MappedFile();
+
+	bool open(const std::string &);
+	void close();
+
+	static std::string tempName(const std::string &);
+	static bool replace(const std::string &, const std::string &);
+
+	bool isOpen() const
+	{
+		return m_data != NULL;
+	}
+
+	const void* getData() const
+	{
+		return m_data;
+	}
+
+	size_t getSize() const
+	{
+		return m_size;
+	}
+};
+
+} /* namespace nl_uu_science_gmt */
+
+#endif /* MAPPEDFILE_H_ */
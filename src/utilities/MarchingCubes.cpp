@@ -0,0 +1,345 @@
+/*
+ * MarchingCubes.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "MarchingCubes.h"
+
+#include <stddef.h>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+using namespace cv;
+
+namespace nl_uu_science_gmt
+{
+
+namespace
+{
+
+const int MAX_CASE_EDGES = 31;        // A cube gives at most 10 triangles, the list ends with -1
+const int WRITE_CHUNK = 65536;        // Triangles per write of the PLY writer
+
+// States of a grid row
+const uchar ROW_OUTSIDE = 0;
+const uchar ROW_INSIDE = 1;
+const uchar ROW_MIXED = 2;
+
+/*
+ * The cube edge between corners a and b (differing in one bit, bit 0, 1 and 2 are x, y
+ * and z), edge e runs along axis e / 4 from the corner with the other two axes' bits e % 4
+ */
+int cubeEdge(
+		int a, int b)
+{
+	const int axis = (a ^ b) == 1 ? 0 : (a ^ b) == 2 ? 1 : 2;
+	const int base = a & b;
+	return axis * 4 + ((base >> ((axis + 1) % 3)) & 1) + (((base >> ((axis + 2) % 3)) & 1) << 1);
+}
+
+/*
+ * The corner an edge starts from
+ */
+int edgeBase(
+		int edge)
+{
+	const int axis = edge / 4;
+	return ((edge & 1) << ((axis + 1) % 3)) | (((edge >> 1) & 1) << ((axis + 2) % 3));
+}
+
+/*
+ * Whether two cube edges lie on a common face of the cube, the face across axis f
+ * holds the edges along the other axes whose corner has bit f on that side
+ */
+bool shareFace(
+		int a, int b)
+{
+	const int base_a = edgeBase(a), base_b = edgeBase(b);
+	for (int f = 0; f < 3; ++f)
+		if (f != a / 4 && f != b / 4 && ((base_a >> f) & 1) == ((base_b >> f) & 1)) return true;
+	return false;
+}
+
+/*
+ * Per cube case (bit i set if corner i is inside) its triangles as triples of cube edges
+ * The cases are built instead of tabulated: on each face of the cube a segment runs,
+ * counter clockwise seen from outside the cube, from an edge entering the inside to the
+ * next edge leaving it, which cuts the inside corners of ambiguous faces apart. As the
+ * segments only depend on the face, the neighbouring cube makes the same choice and the
+ * mesh has no holes. The segments form loops around the surface inside the cube, the
+ * loops are triangulated by clipping ears, counter clockwise seen from outside the surface.
+ * An ear's new edge must not join two vertices on a common cube face: the neighbouring
+ * cube across that face may join them too, and the edge would be shared by more than
+ * two triangles. Every loop of the 256 cases has such an ear.
+ */
+struct CaseTable
+{
+	signed char edges[256][MAX_CASE_EDGES];
+
+	CaseTable()
+	{
+		for (int c = 0; c < 256; ++c)
+		{
+			int next[12];
+			std::fill(next, next + 12, -1);
+			for (int f = 0; f < 3; ++f)
+			{
+				const int u = 1 << ((f + 1) % 3), v = 1 << ((f + 2) % 3);
+				for (int s = 0; s < 2; ++s)
+				{
+					// Counter clockwise seen from outside the cube
+					const int base = s << f;
+					const int corners[] = { base, base | (s ? u : v), base | u | v, base | (s ? v : u) };
+					for (int i = 0; i < 4; ++i)
+					{
+						const int a = corners[i], b = corners[(i + 1) % 4];
+						if (((c >> a) & 1) || !((c >> b) & 1)) continue;
+
+						for (int j = 1; j < 4; ++j)
+						{
+							const int a2 = corners[(i + j) % 4], b2 = corners[(i + j + 1) % 4];
+							if (((c >> a2) & 1) && !((c >> b2) & 1))
+							{
+								next[cubeEdge(a, b)] = cubeEdge(a2, b2);
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			int n = 0;
+			bool done[12] = { false };
+			for (int e = 0; e < 12; ++e)
+			{
+				if (next[e] < 0 || done[e]) continue;
+
+				vector<int> loop;
+				for (int l = e; !done[l]; l = next[l])
+				{
+					assert(next[l] >= 0);
+					done[l] = true;
+					loop.push_back(l);
+				}
+				assert(loop.size() >= 3);
+
+				while (loop.size() > 3)
+				{
+					const size_t size = loop.size();
+					size_t ear = 0;
+					while (ear < size && shareFace(loop[(ear + size - 1) % size], loop[(ear + 1) % size]))
+						++ear;
+					assert(ear < size);
+
+					edges[c][n++] = (signed char) loop[(ear + size - 1) % size];
+					edges[c][n++] = (signed char) loop[ear];
+					edges[c][n++] = (signed char) loop[(ear + 1) % size];
+					loop.erase(loop.begin() + ear);
+				}
+
+				for (size_t i = 0; i < 3; ++i)
+					edges[c][n++] = (signed char) loop[i];
+			}
+			assert(n < MAX_CASE_EDGES);
+			edges[c][n] = -1;
+		}
+	}
+};
+
+} /* namespace */
+
+/**
+ * Extract the surface where the field crosses iso (above it is inside) as a mesh
+ * The field has size.width x size.height x depth values (x fastest), its first value
+ * is at origin and they're step apart.
+ * Per z-plane, in parallel, the crossed edges starting in the plane get their vertex
+ * (by linear interpolation), numbered per plane; after counting, per z-plane the cubes
+ * starting in it look their edges' vertices up, so neighbouring cubes share them.
+ * Rows of grid points and cubes that are all inside or all outside along with their
+ * neighbouring rows are skipped.
+ */
+void MarchingCubes::extract(
+		const vector<float> &field, const Size &size, int depth, float iso, const Point3f &origin, float step,
+		Mesh &mesh)
+{
+	static const CaseTable table;
+
+	const int nx = size.width, ny = size.height;
+	const size_t plane = (size_t) nx * ny;
+	assert(field.size() == plane * depth);
+
+	m_row_states.resize((size_t) ny * depth);
+	m_edge_vertices.resize(3 * plane * depth);
+	m_slab_vertices.resize(depth);
+	m_slab_triangles.resize(depth);
+
+	int z;
+#pragma omp parallel for schedule(static) private(z)
+	for (z = 0; z < depth; ++z)
+	{
+		for (int y = 0; y < ny; ++y)
+		{
+			const float* values = &field[z * plane + y * nx];
+			int inside = 0;
+			for (int x = 0; x < nx; ++x)
+				inside += values[x] > iso;
+			m_row_states[z * ny + y] = inside == 0 ? ROW_OUTSIDE : inside == nx ? ROW_INSIDE : ROW_MIXED;
+		}
+	}
+
+#pragma omp parallel for schedule(dynamic) private(z)
+	for (z = 0; z < depth; ++z)
+	{
+		vector<Point3f> &vertices = m_slab_vertices[z];
+		vertices.clear();
+
+		const float* values = &field[z * plane];
+		int* edges = &m_edge_vertices[3 * z * plane];
+		for (int y = 0; y < ny; ++y)
+		{
+			const uchar* states = &m_row_states[z * ny + y];
+			if (states[0] != ROW_MIXED && (y + 1 == ny || states[1] == states[0])
+					&& (z + 1 == depth || states[ny] == states[0])) continue;
+
+			for (int x = 0; x < nx; ++x)
+			{
+				const int i = y * nx + x;
+				const float value = values[i];
+				const bool inside = value > iso;
+				const Point3f point(origin.x + x * step, origin.y + y * step, origin.z + z * step);
+
+				if (x + 1 < nx && (values[i + 1] > iso) != inside)
+				{
+					edges[3 * i] = (int) vertices.size();
+					vertices.push_back(point + Point3f(step * (iso - value) / (values[i + 1] - value), 0, 0));
+				}
+				if (y + 1 < ny && (values[i + nx] > iso) != inside)
+				{
+					edges[3 * i + 1] = (int) vertices.size();
+					vertices.push_back(point + Point3f(0, step * (iso - value) / (values[i + nx] - value), 0));
+				}
+				if (z + 1 < depth && (values[i + plane] > iso) != inside)
+				{
+					edges[3 * i + 2] = (int) vertices.size();
+					vertices.push_back(point + Point3f(0, 0, step * (iso - value) / (values[i + plane] - value)));
+				}
+			}
+		}
+	}
+
+	vector<int> vertex_offsets(depth + 1, 0);
+	for (z = 0; z < depth; ++z)
+		vertex_offsets[z + 1] = vertex_offsets[z] + (int) m_slab_vertices[z].size();
+
+	// Per cube corner its offset in the field, per cube edge the offset of its grid edge
+	int corner_offsets[8], edge_offsets[12];
+	for (int k = 0; k < 8; ++k)
+		corner_offsets[k] = (k & 1) + ((k >> 1) & 1) * nx + ((k >> 2) & 1) * (int) plane;
+	for (int e = 0; e < 12; ++e)
+		edge_offsets[e] = 3 * corner_offsets[edgeBase(e)] + e / 4;
+
+#pragma omp parallel for schedule(dynamic) private(z)
+	for (z = 0; z < depth; ++z)
+	{
+		vector<Vec3i> &triangles = m_slab_triangles[z];
+		triangles.clear();
+		if (z + 1 == depth) continue;
+
+		for (int y = 0; y + 1 < ny; ++y)
+		{
+			const uchar* states = &m_row_states[z * ny + y];
+			if (states[0] != ROW_MIXED && states[1] == states[0] && states[ny] == states[0] && states[ny + 1] == states[0]) continue;
+
+			for (int x = 0; x + 1 < nx; ++x)
+			{
+				const size_t i = z * plane + y * nx + x;
+				int cube = 0;
+				for (int k = 0; k < 8; ++k)
+					cube |= (field[i + corner_offsets[k]] > iso) << k;
+				if (cube == 0 || cube == 255) continue;
+
+				int vertex[12];
+				const signed char* edges = table.edges[cube];
+				for (int n = 0; edges[n] >= 0; ++n)
+				{
+					const int e = edges[n];
+					vertex[n % 3] = m_edge_vertices[3 * i + edge_offsets[e]] + vertex_offsets[z + ((edgeBase(e) >> 2) & 1)];
+					if (n % 3 == 2) triangles.push_back(Vec3i(vertex[0], vertex[1], vertex[2]));
+				}
+			}
+		}
+	}
+
+	vector<int> triangle_offsets(depth + 1, 0);
+	for (z = 0; z < depth; ++z)
+		triangle_offsets[z + 1] = triangle_offsets[z] + (int) m_slab_triangles[z].size();
+
+	mesh.vertices.resize(vertex_offsets[depth]);
+	mesh.triangles.resize(triangle_offsets[depth]);
+#pragma omp parallel for schedule(dynamic) private(z)
+	for (z = 0; z < depth; ++z)
+	{
+		std::copy(m_slab_vertices[z].begin(), m_slab_vertices[z].end(), mesh.vertices.begin() + vertex_offsets[z]);
+		std::copy(m_slab_triangles[z].begin(), m_slab_triangles[z].end(), mesh.triangles.begin() + triangle_offsets[z]);
+	}
+}
+
+/**
+ * Write the mesh as binary (little endian, as on x86 and ARM) PLY, the vertices
+ * straight from the mesh and the faces through a buffer of WRITE_CHUNK faces
+ */
+bool MarchingCubes::writePly(
+		const string &file, const Mesh &mesh)
+{
+	ofstream out(file.c_str(), ios::binary);
+	if (!out) return false;
+
+	out << "ply\nformat binary_little_endian 1.0\n";
+	out << "element vertex " << mesh.vertices.size() << "\n";
+	out << "property float x\nproperty float y\nproperty float z\n";
+	out << "element face " << mesh.triangles.size() << "\n";
+	out << "property list uchar int vertex_indices\nend_header\n";
+
+	if (!mesh.vertices.empty())
+		out.write((const char*) &mesh.vertices[0], mesh.vertices.size() * sizeof(Point3f));
+
+	const size_t face_bytes = 1 + 3 * sizeof(int);
+	vector<char> buffer(WRITE_CHUNK * face_bytes);
+	for (size_t t = 0; t < mesh.triangles.size(); t += WRITE_CHUNK)
+	{
+		const size_t end = std::min(mesh.triangles.size(), t + WRITE_CHUNK);
+		char* face = &buffer[0];
+		for (size_t i = t; i < end; ++i, face += face_bytes)
+		{
+			face[0] = 3;
+			memcpy(face + 1, mesh.triangles[i].val, 3 * sizeof(int));
+		}
+		out.write(&buffer[0], (end - t) * face_bytes);
+	}
+
+	return out.good();
+}
+
+/**
+ * Write the mesh as (text) OBJ
+ */
+bool MarchingCubes::writeObj(
+		const string &file, const Mesh &mesh)
+{
+	ofstream out(file.c_str());
+	if (!out) return false;
+
+	for (size_t v = 0; v < mesh.vertices.size(); ++v)
+		out << "v " << mesh.vertices[v].x << " " << mesh.vertices[v].y << " " << mesh.vertices[v].z << "\n";
+
+	// OBJ counts the vertices from 1
+	for (size_t t = 0; t < mesh.triangles.size(); ++t)
+		out << "f " << mesh.triangles[t][0] + 1 << " " << mesh.triangles[t][1] + 1 << " " << mesh.triangles[t][2] + 1 << "\n";
+
+	return out.good();
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,50 @@
+/*
+ * MarchingCubes.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef MARCHINGCUBES_H_
+#define MARCHINGCUBES_H_
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+namespace nl_uu_science_gmt
+{
+
+/*
+ * Triangle mesh, the triangles are counter clockwise seen from outside
+ */
+struct Mesh
+{
+	std::vector<cv::Point3f> vertices;
+	std::vector<cv::Vec3i> triangles;
+};
+
+/*
+ * Extracts the iso-surface of a scalar field on a regular grid as a closed (apart
+ * from the grid's border) triangle mesh, slab (z-plane) parallel, with the vertices
+ * shared between the triangles of neighbouring cubes
+ */
+class MarchingCubes
+{
+	std::vector<uchar> m_row_states;                  // Per grid row (y, z) whether it's all outside, all inside or mixed
+	std::vector<int> m_edge_vertices;                 // Per grid edge (3 per grid point) its vertex, only set for crossed edges
+	std::vector<std::vector<cv::Point3f> > m_slab_vertices;   // Per z-plane the vertices on the edges starting in it
+	std::vector<std::vector<cv::Vec3i> > m_slab_triangles;    // Per z-plane the triangles of the cubes starting in it
+
+public:
+	void extract(
+			const std::vector<float> &, const cv::Size &, int, float, const cv::Point3f &, float, Mesh &);
+
+	static bool writePly(
+			const std::string &, const Mesh &);
+	static bool writeObj(
+			const std::string &, const Mesh &);
+};
+
+} /* namespace nl_uu_science_gmt */
+
+#endif /* MARCHINGCUBES_H_ */
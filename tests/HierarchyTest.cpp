@@ -0,0 +1,100 @@
+/*
+ * HierarchyTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that carving coarse to fine through the hierarchy gives bit for bit the
+ * visible voxels of carving every word, with and without region of interest culling,
+ * on scenes from a single person to a crowd.
+ *
+ * usage: HierarchyTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+bool check(
+		bool condition, const string &what)
+{
+	cout << (condition ? "OK   " : "FAIL ") << what << endl;
+	return condition;
+}
+
+/**
+ * Carve the current foregrounds with the hierarchy and with every word, and compare
+ * the visible bits word for word
+ */
+bool checkHierarchy(
+		Reconstructor &reconstructor, const string &scene)
+{
+	reconstructor.setHierarchical(false);
+	reconstructor.update();
+	const vector<uint64_t> dense = reconstructor.getVisibleBits();
+	const size_t voxels = reconstructor.getVisibleVoxels().size();
+
+	reconstructor.setHierarchical(true);
+	reconstructor.update();
+	const vector<uint64_t> &hierarchical = reconstructor.getVisibleBits();
+
+	stringstream what;
+	what << scene << ": the hierarchical carve matches the dense carve (" << voxels << " voxels)";
+	return check(hierarchical == dense, what.str());
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+	reconstructor->setIncremental(false);
+	reconstructor->setVoteDensity(0);       // Every frame through the dense or hierarchical carve
+	reconstructor->setMaxVelocity(0);       // Both carves carve the same region
+
+	bool passed = true;
+	for (int roi = 0; roi < 2; ++roi)
+	{
+		reconstructor->setRoiCulling(roi != 0);
+		const string culling = roi ? " with ROI culling" : "";
+
+		vector<Point2f> people(1, Point2f(-600, -300));
+		TestScene::setForegrounds(cameras, people);
+		passed &= checkHierarchy(*reconstructor, "A person" + culling);
+
+		TestScene::setForegrounds(cameras, people, true);
+		passed &= checkHierarchy(*reconstructor, "A person and a blob per camera" + culling);
+
+		people.push_back(Point2f(600, 400));
+		people.push_back(Point2f(-900, 1000));
+		people.push_back(Point2f(1100, -800));
+		people.push_back(Point2f(0, 0));
+		TestScene::setForegrounds(cameras, people);
+		passed &= checkHierarchy(*reconstructor, "A crowd" + culling);
+	}
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
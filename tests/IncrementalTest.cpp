@@ -0,0 +1,108 @@
+/*
+ * IncrementalTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that incremental carving follows the full carve over a sequence of frames:
+ * a person walking in small steps, a crowd walking in, blobs that only one camera
+ * sees coming and going, the scene emptying and a person coming back.
+ *
+ * usage: IncrementalTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const int STEPS = 6;          // Frames of the walk
+const float STEP = 40;        // mm the person walks per frame
+
+bool check(
+		bool condition, const string &what)
+{
+	cout << (condition ? "OK   " : "FAIL ") << what << endl;
+	return condition;
+}
+
+/**
+ * Carve the current foregrounds incrementally and check them against the full carve
+ */
+bool checkFrame(
+		Reconstructor &reconstructor, const vector<Camera*> &cameras, const string &frame)
+{
+	reconstructor.update();
+
+	vector<int> visible = reconstructor.getVisibleVoxels();
+	sort(visible.begin(), visible.end());
+	const vector<int> reference = TestScene::carve(reconstructor, cameras);
+
+	stringstream what;
+	what << frame << ": the incremental carve matches the full carve (" << visible.size() << " of "
+			<< reference.size() << " voxels)";
+	return check(visible == reference, what.str());
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+	reconstructor->setIncremental(true);
+
+	bool passed = true;
+	vector<Point2f> people(1, Point2f(-600, -300));
+	for (int s = 0; s < STEPS; ++s)
+	{
+		people[0].x += STEP;
+		TestScene::setForegrounds(cameras, people);
+		stringstream frame;
+		frame << "Walk step " << s + 1;
+		passed &= checkFrame(*reconstructor, cameras, frame.str());
+	}
+
+	people.push_back(Point2f(600, 400));
+	people.push_back(Point2f(-900, 1000));
+	people.push_back(Point2f(1100, -800));
+	people.push_back(Point2f(0, 0));
+	TestScene::setForegrounds(cameras, people);
+	passed &= checkFrame(*reconstructor, cameras, "A crowd walks in");
+
+	TestScene::setForegrounds(cameras, people, true);
+	passed &= checkFrame(*reconstructor, cameras, "Blobs appear");
+
+	people.erase(people.begin() + 1, people.begin() + 3);
+	TestScene::setForegrounds(cameras, people);
+	passed &= checkFrame(*reconstructor, cameras, "The blobs and two people leave");
+
+	TestScene::setForegrounds(cameras, vector<Point2f>());
+	passed &= checkFrame(*reconstructor, cameras, "The scene empties");
+
+	TestScene::setForegrounds(cameras, vector<Point2f>(1, Point2f(800, -200)));
+	passed &= checkFrame(*reconstructor, cameras, "A person comes back");
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,114 @@
+/*
+ * MeshBenchmark.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Times the mesh extraction against the reconstruction it meshes, frame by frame,
+ * on people walking circles in front of the cameras of the data directory, and
+ * checks that every mesh is closed with each edge shared by exactly two triangles.
+ * The mesh keeps up when the update and the mesh together stay within a frame's time.
+ *
+ * usage: MeshBenchmark [data path] [frames]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "../src/utilities/MarchingCubes.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const int PEOPLE = 3;
+const float WALK_RADIUS = 800;        // mm, radius of the circles the people walk
+const float WALK_SPEED = 0.05f;       // rad per frame
+const double FRAME_TIME = 40;         // ms, a frame at 25 fps
+
+/**
+ * Whether every directed edge of the mesh is in exactly one triangle and its reverse
+ * in exactly one other: the mesh is closed and no edge is shared by more than two
+ */
+bool isManifold(
+		const Mesh &mesh)
+{
+	const uint64_t vertices = mesh.vertices.size();
+	vector<uint64_t> edges, reversed;
+	for (size_t t = 0; t < mesh.triangles.size(); ++t)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			const uint64_t a = mesh.triangles[t][k], b = mesh.triangles[t][(k + 1) % 3];
+			edges.push_back(a * vertices + b);
+			reversed.push_back(b * vertices + a);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	std::sort(reversed.begin(), reversed.end());
+	return std::adjacent_find(edges.begin(), edges.end()) == edges.end() && edges == reversed;
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	const int frames = argc > 2 ? atoi(argv[2]) : 100;
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+
+	double update_total = 0, update_max = 0, mesh_total = 0, mesh_max = 0;
+	size_t triangles = 0;
+	int failed = 0;
+	for (int f = 0; f < frames; ++f)
+	{
+		vector<Point2f> people;
+		for (int p = 0; p < PEOPLE; ++p)
+		{
+			const float angle = f * WALK_SPEED + p * 2 * (float) CV_PI / PEOPLE;
+			people.push_back(Point2f(WALK_RADIUS * cos(angle), WALK_RADIUS * sin(angle)));
+		}
+		TestScene::setForegrounds(cameras, people);
+
+		const int64 start = getTickCount();
+		reconstructor->update();
+		const double update_time = (getTickCount() - start) * 1000.0 / getTickFrequency();
+		const Mesh &mesh = reconstructor->getMesh();
+		const double mesh_time = reconstructor->getMeshTime();
+
+		update_total += update_time;
+		update_max = std::max(update_max, update_time);
+		mesh_total += mesh_time;
+		mesh_max = std::max(mesh_max, mesh_time);
+		triangles += mesh.triangles.size();
+		if (!isManifold(mesh)) ++failed;
+	}
+
+	cout << frames << " frames, " << reconstructor->getVisibleVoxels().size() << " visible voxels in the last, "
+			<< triangles / std::max(1, frames) << " triangles per mesh" << endl;
+	cout << "Update: " << update_total / frames << "ms per frame, at most " << update_max << "ms" << endl;
+	cout << "Mesh:   " << mesh_total / frames << "ms per frame, at most " << mesh_max << "ms" << endl;
+	cout << "Update and mesh take " << (update_total + mesh_total) / frames * 100 / FRAME_TIME << "% of a frame at 25 fps"
+			<< endl;
+	cout << (failed ? "FAIL " : "OK   ") << failed << " meshes not closed or with edges in more than two triangles" << endl;
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
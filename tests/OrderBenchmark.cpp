@@ -0,0 +1,122 @@
+/*
+ * OrderBenchmark.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Times the update frame by frame under each voxel order (linear, morton and
+ * bricks), on people walking circles in front of the cameras of the data directory,
+ * and checks that every order carves the voxels of the full carve. Each order is
+ * configured by a copy of the voxel space config next to it, which is removed after;
+ * the LUT cache is rebuilt for every order.
+ *
+ * usage: OrderBenchmark [data path] [frames]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const int PEOPLE = 3;
+const float WALK_RADIUS = 800;        // mm, radius of the circles the people walk
+const float WALK_SPEED = 0.05f;       // rad per frame
+const char* const ORDERS[] = { "linear", "morton", "bricks" };
+
+/**
+ * Write a copy of the voxel space config with the given VoxelOrder, return its name
+ */
+string writeConfig(
+		const string &data_path, const string &config, const string &order)
+{
+	const string element = "<VoxelOrder>" + order + "</VoxelOrder>";
+	string copy = config;
+	const size_t first = copy.find("<VoxelOrder>");
+	const size_t last = copy.find("</VoxelOrder>");
+	if (first != string::npos && last != string::npos)
+		copy.replace(first, last + string("</VoxelOrder>").size() - first, element);
+	else
+		copy.insert(copy.find("</opencv_storage>"), element + "\n");
+
+	const string name = "voxels." + order + ".xml";
+	ofstream file((data_path + name).c_str());
+	file << copy;
+	return name;
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	const int frames = argc > 2 ? atoi(argv[2]) : 100;
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	// The default config when the data directory has none
+	stringstream config;
+	ifstream file((data_path + General::VoxelConfigFile).c_str());
+	if (file)
+		config << file.rdbuf();
+	else
+		config << "<?xml version=\"1.0\"?>\n<opencv_storage>\n</opencv_storage>\n";
+
+	int failed = 0;
+	for (int o = 0; o < 3; ++o)
+	{
+		const string name = writeConfig(data_path, config.str(), ORDERS[o]);
+		Reconstructor* reconstructor = new Reconstructor(cameras, name);
+		remove((data_path + name).c_str());
+
+		double total = 0, most = 0;
+		int wrong = 0;
+		for (int f = 0; f < frames; ++f)
+		{
+			vector<Point2f> people;
+			for (int p = 0; p < PEOPLE; ++p)
+			{
+				const float angle = f * WALK_SPEED + p * 2 * (float) CV_PI / PEOPLE;
+				people.push_back(Point2f(WALK_RADIUS * cos(angle), WALK_RADIUS * sin(angle)));
+			}
+			TestScene::setForegrounds(cameras, people);
+
+			const int64 start = getTickCount();
+			reconstructor->update();
+			const double time = (getTickCount() - start) * 1000.0 / getTickFrequency();
+			total += time;
+			most = std::max(most, time);
+
+			vector<int> visible = reconstructor->getVisibleVoxels();
+			sort(visible.begin(), visible.end());
+			if (visible != TestScene::carve(*reconstructor, cameras)) ++wrong;
+		}
+
+		cout << (wrong ? "FAIL " : "OK   ") << ORDERS[reconstructor->getVoxelOrder()] << ": " << total / std::max(1, frames)
+				<< "ms per frame, at most " << most << "ms, " << wrong << " of " << frames
+				<< " frames differ from the full carve" << endl;
+		failed += wrong;
+		delete reconstructor;
+	}
+
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
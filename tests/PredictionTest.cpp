@@ -0,0 +1,128 @@
+/*
+ * PredictionTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that the region prediction of Reconstructor::update gives way to people
+ * it doesn't explain yet: someone walking in while foreground that explained nothing
+ * vanishes, and someone standing still next to the predicted region while one camera
+ * gradually uncovers them, a little new foreground each frame.
+ *
+ * usage: PredictionTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const Point2f THIRD(-700, -1500);  // Where the third person stands, next to the first
+const int STILL_FRAMES = 3;        // Frames the third person stands fully uncovered
+
+bool check(
+		bool condition, const string &what)
+{
+	cout << (condition ? "OK   " : "FAIL ") << what << endl;
+	return condition;
+}
+
+/**
+ * Whether the visible voxels of the last update are those of the full carve
+ */
+bool isFullCarve(
+		const Reconstructor &reconstructor, const vector<Camera*> &cameras)
+{
+	vector<int> visible = reconstructor.getVisibleVoxels();
+	sort(visible.begin(), visible.end());
+	return visible == TestScene::carve(reconstructor, cameras);
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+	reconstructor->setIncremental(false);   // Only the word carves predict
+	reconstructor->setVoteDensity(0);
+
+	// One person, twice so the second update is predicted
+	vector<Point2f> people(1, Point2f(-1500, -1500));
+	TestScene::setForegrounds(cameras, people);
+	reconstructor->update();
+	reconstructor->update();
+	bool passed = check(reconstructor->isPredicted(), "An unchanged scene is predicted");
+	const size_t alone = reconstructor->getVisibleVoxels().size();
+
+	// A blob per camera that no voxel explains, then the blobs vanish and a second person walks in
+	TestScene::setForegrounds(cameras, people, true);
+	reconstructor->update();
+	reconstructor->update();
+	people.push_back(Point2f(900, -1500));
+	TestScene::setForegrounds(cameras, people);
+	reconstructor->update();
+
+	const vector<int> reference = TestScene::carve(*reconstructor, cameras);
+	passed &= check(reference.size() > alone, "The second person adds voxels");
+	passed &= check(!reconstructor->isPredicted(), "The second person isn't predicted away");
+	passed &= check(isFullCarve(*reconstructor, cameras), "The visible voxels match the full carve");
+
+	// The second person leaves, and a third stands still just outside the predicted region,
+	// hidden on the first camera behind an occluder that uncovers a column per frame
+	people.pop_back();
+	TestScene::setForegrounds(cameras, people);
+	reconstructor->update();
+	reconstructor->update();
+
+	const vector<Camera*> occluded(1, cameras.front());
+	TestScene::setForegrounds(occluded, people);
+	const Mat hidden = cameras.front()->getForegroundImage().clone();
+	TestScene::setForegrounds(occluded, vector<Point2f>(1, THIRD));
+	const Rect third = cameras.front()->getForegroundBox();
+
+	people.push_back(THIRD);
+	TestScene::setForegrounds(cameras, people);
+	const Mat uncovered = cameras.front()->getForegroundImage().clone();
+
+	bool full = true;
+	for (int x = third.x; x <= third.x + third.width + STILL_FRAMES; ++x)
+	{
+		// Left of column x the first camera sees the third person, right of it only the first
+		Mat foreground = uncovered.clone();
+		if (x < foreground.cols)
+		{
+			const Rect occluder(x, 0, foreground.cols - x, foreground.rows);
+			Mat behind = foreground(occluder);
+			hidden(occluder).copyTo(behind);
+		}
+		cameras.front()->setForegroundImage(foreground);
+
+		reconstructor->update();
+		full &= isFullCarve(*reconstructor, cameras);
+	}
+	passed &= check(TestScene::carve(*reconstructor, cameras).size() > alone, "The third person adds voxels");
+	passed &= check(full, "The third person matches the full carve in every frame");
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
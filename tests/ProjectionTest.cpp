@@ -0,0 +1,84 @@
+/*
+ * ProjectionTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that the batch projection the LUT is built with agrees with OpenCV's
+ * projectPoints on every grid point of the reconstructor's voxel space, for every
+ * camera of the data directory.
+ *
+ * usage: ProjectionTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const double MAX_ERROR = 1e-2;    // pixels
+
+bool check(
+		bool condition, const string &what)
+{
+	cout << (condition ? "OK   " : "FAIL ") << what << endl;
+	return condition;
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+
+	// The grid points span the volume's corners from the lowest one, a step apart
+	const vector<Point3f*> &corners = reconstructor->getCorners();
+	Point3f low(FLT_MAX, FLT_MAX, FLT_MAX), high(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < corners.size(); ++i)
+	{
+		low = Point3f(std::min(low.x, corners[i]->x), std::min(low.y, corners[i]->y), std::min(low.z, corners[i]->z));
+		high = Point3f(std::max(high.x, corners[i]->x), std::max(high.y, corners[i]->y), std::max(high.z, corners[i]->z));
+	}
+
+	const float step = (float) reconstructor->getStep();
+	vector<Point3f> grid;
+	for (float z = low.z; z < high.z; z += step)
+		for (float y = low.y; y < high.y; y += step)
+			for (float x = low.x; x < high.x; x += step)
+				grid.push_back(Point3f(x, y, z));
+
+	bool passed = true;
+	for (size_t c = 0; c < cameras.size(); ++c)
+	{
+		const double error = cameras[c]->projectionError(grid);
+		stringstream what;
+		what << "Camera " << cameras[c]->getId() << ": the batch projection of " << grid.size()
+				<< " grid points is within " << MAX_ERROR << " pixels of projectPoints (" << error << ")";
+		passed &= check(error < MAX_ERROR, what.str());
+	}
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
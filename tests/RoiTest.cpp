@@ -0,0 +1,100 @@
+/*
+ * RoiTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that the region of interest Reconstructor::update carves is conservative:
+ * every voxel that projects inside the foreground box of every camera is in it. Thin
+ * slanted poles make the back-projected region a thin slanted polytope, whose rows
+ * near a tip round to no voxels in between rows that still hold some.
+ *
+ * usage: RoiTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const int POLES = 200;
+const float POLE_HEIGHT = 1800;       // mm
+const float POLE_LEAN = 1500;         // mm, how far the top may be from the foot
+
+/**
+ * Amount of voxels inside all cameras' foreground boxes that are missing from the ROI
+ */
+int missingFromRoi(
+		const Reconstructor &reconstructor, const vector<Camera*> &cameras)
+{
+	const vector<uint64_t> &roi = reconstructor.getRoiBits();
+	int missing = 0;
+	for (size_t v = 0; v < reconstructor.getVoxelsAmount(); ++v)
+	{
+		size_t c = 0;
+		for (; c < cameras.size(); ++c)
+		{
+			const int pixel = reconstructor.getLut(c)[v];
+			const int width = cameras[c]->getSize().width;
+			if (pixel < 0 || !cameras[c]->getForegroundBox().contains(Point(pixel % width, pixel / width))) break;
+		}
+		if (c == cameras.size() && !((roi[v / 64] >> (v % 64)) & 1)) ++missing;
+	}
+	return missing;
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+	reconstructor->setRoiCulling(true);
+	reconstructor->setMaxVelocity(0);        // The region is the ROI, not a prediction
+	reconstructor->setIncremental(false);
+	reconstructor->setVoteDensity(0);        // Thin poles are sparse, the votes don't use the ROI
+
+	RNG rng(12345);
+	int failed = 0, missing = 0;
+	for (int p = 0; p < POLES; ++p)
+	{
+		vector<Point3f> ends;
+		const Point3f foot(rng.uniform(-1500.f, 1500.f), rng.uniform(-1500.f, 1500.f), 0);
+		ends.push_back(foot);
+		ends.push_back(foot + Point3f(rng.uniform(-POLE_LEAN, POLE_LEAN), rng.uniform(-POLE_LEAN, POLE_LEAN), POLE_HEIGHT));
+		TestScene::setPoles(cameras, ends);
+		reconstructor->update();
+
+		const int pole_missing = missingFromRoi(*reconstructor, cameras);
+		vector<int> visible = reconstructor->getVisibleVoxels();
+		sort(visible.begin(), visible.end());
+		if (pole_missing > 0 || visible != TestScene::carve(*reconstructor, cameras)) ++failed;
+		missing += pole_missing;
+	}
+
+	cout << (failed ? "FAIL " : "OK   ") << failed << " of " << POLES << " poles with voxels in all foreground boxes outside the ROI ("
+			<< missing << " voxels) or a carve that differs from the full carve" << endl;
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
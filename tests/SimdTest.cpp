@@ -0,0 +1,96 @@
+/*
+ * SimdTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that the AVX2 word carving kernel gives bit for bit the visible voxels of
+ * the scalar one, for 2 to 8 cameras (every fixed camera count kernel); the cameras
+ * of the data directory are repeated for more than 4. Without AVX2 on the CPU or in
+ * the build only the scalar kernel is checked against the full carve.
+ *
+ * usage: SimdTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+const int MIN_CAMERAS = 2;
+const int MAX_CAMERAS = 8;
+const int FRAMES = 5;
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	const vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	bool passed = true, simd = false;
+	for (int amount = MIN_CAMERAS; amount <= MAX_CAMERAS; ++amount)
+	{
+		vector<Camera*> views;
+		for (int c = 0; c < amount; ++c)
+			views.push_back(cameras[c % cameras.size()]);
+
+		Reconstructor* reconstructor = new Reconstructor(views);
+		reconstructor->setIncremental(false);
+		reconstructor->setVoteDensity(0);      // Every word through the word kernel
+		reconstructor->setHierarchical(false);
+		reconstructor->setMaxVelocity(0);      // Both kernels carve the same region
+
+		int differing = 0, wrong = 0;
+		for (int f = 0; f < FRAMES; ++f)
+		{
+			vector<Point2f> people;
+			for (int p = 0; p <= f; ++p)
+				people.push_back(Point2f(-1200 + 600 * p, 900 - 450 * ((p + f) % 5)));
+			TestScene::setForegrounds(views, people);
+
+			reconstructor->setSimd(false);
+			reconstructor->update();
+			const vector<uint64_t> scalar = reconstructor->getVisibleBits();
+			vector<int> visible = reconstructor->getVisibleVoxels();
+			sort(visible.begin(), visible.end());
+			if (visible != TestScene::carve(*reconstructor, views)) ++wrong;
+
+			reconstructor->setSimd(true);
+			if (!reconstructor->isSimd()) continue;
+			simd = true;
+
+			reconstructor->update();
+			const vector<uint64_t> &avx = reconstructor->getVisibleBits();
+			for (size_t w = 0; w < scalar.size(); ++w)
+				differing += scalar[w] != avx[w];
+		}
+
+		cout << (differing || wrong ? "FAIL " : "OK   ") << amount << " cameras: " << differing
+				<< " words differ between the kernels, " << wrong << " of " << FRAMES << " scalar carves differ from the full carve" << endl;
+		passed &= !differing && !wrong;
+		delete reconstructor;
+	}
+
+	if (!simd) cout << "No AVX2, only the scalar kernel was checked" << endl;
+
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
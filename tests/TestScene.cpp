@@ -0,0 +1,154 @@
+/*
+ * TestScene.cpp
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#include "TestScene.h"
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+
+using namespace std;
+using namespace cv;
+
+namespace nl_uu_science_gmt
+{
+
+namespace
+{
+
+const float PERSON_RADIUS = 250;     // mm
+const float PERSON_HEIGHT = 1700;    // mm
+const float SAMPLE_STEP = 15;        // mm between the sampled surface points of a person
+const int BLOB_SIZE = 200;           // Side of the blob that only a single camera sees (pixels)
+
+/**
+ * Draw the points on each camera's view as 3x3 pixel dots
+ */
+vector<Mat> drawPoints(
+		const vector<Camera*> &cameras, const vector<Point3f> &points)
+{
+	vector<Mat> foregrounds;
+	for (size_t c = 0; c < cameras.size(); ++c)
+	{
+		const Size size = cameras[c]->getSize();
+		Mat foreground = Mat::zeros(size, CV_8U);
+
+		vector<Point2f> image_points;
+		cameras[c]->projectOnView(points, image_points);
+		for (size_t i = 0; i < image_points.size(); ++i)
+		{
+			const Point point(cvRound(image_points[i].x), cvRound(image_points[i].y));
+			const Rect dot = Rect(point.x - 1, point.y - 1, 3, 3) & Rect(0, 0, size.width, size.height);
+			if (dot.area() > 0) foreground(dot).setTo(255);
+		}
+		foregrounds.push_back(foreground);
+	}
+	return foregrounds;
+}
+
+} /* namespace */
+
+/**
+ * Initialize the cameras cam1 .. cam4 below the data path, exit on failure
+ */
+vector<Camera*> TestScene::loadCameras(
+		const string &data_path)
+{
+	vector<Camera*> cameras;
+	for (int v = 0; v < 4; ++v)
+	{
+		stringstream full_path;
+		full_path << data_path << "cam" << (v + 1) << PATH_SEP;
+		cameras.push_back(new Camera(full_path.str(), General::ConfigFile, v));
+		if (!cameras.back()->initialize())
+		{
+			cerr << "Unable to initialize camera " << full_path.str() << endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+	return cameras;
+}
+
+/**
+ * Set the foreground of each camera to the people at the given floor positions,
+ * optionally with a blob in a corner of each view (a different corner per camera)
+ * that no person explains
+ */
+void TestScene::setForegrounds(
+		const vector<Camera*> &cameras, const vector<Point2f> &people, bool blob)
+{
+	vector<Point3f> points;
+	for (size_t p = 0; p < people.size(); ++p)
+		for (float z = 0; z <= PERSON_HEIGHT; z += SAMPLE_STEP)
+			for (float r = 0; r <= PERSON_RADIUS; r += 2 * SAMPLE_STEP)
+				for (float a = 0; a < 2 * CV_PI; a += SAMPLE_STEP / PERSON_RADIUS)
+					points.push_back(Point3f(people[p].x + r * cos(a), people[p].y + r * sin(a), z));
+
+	vector<Mat> foregrounds = drawPoints(cameras, points);
+	for (size_t c = 0; c < cameras.size(); ++c)
+	{
+		const Size size = cameras[c]->getSize();
+		Mat &foreground = foregrounds[c];
+
+		if (blob)
+		{
+			const int id = cameras[c]->getId();
+			foreground(Rect((id / 2) * (size.width - BLOB_SIZE), (id % 2) * (size.height - BLOB_SIZE), BLOB_SIZE, BLOB_SIZE)).setTo(255);
+		}
+
+		cameras[c]->setForegroundImage(foreground);
+	}
+}
+
+/**
+ * Set the foreground of each camera to thin poles, the segments between the
+ * consecutive pairs of end points
+ */
+void TestScene::setPoles(
+		const vector<Camera*> &cameras, const vector<Point3f> &ends)
+{
+	vector<Point3f> points;
+	for (size_t e = 0; e + 1 < ends.size(); e += 2)
+	{
+		const Point3f direction = ends[e + 1] - ends[e];
+		const int samples = std::max(1, cvCeil(norm(direction) / (SAMPLE_STEP / 3)));
+		for (int i = 0; i <= samples; ++i)
+			points.push_back(ends[e] + direction * (float) ((double) i / samples));
+	}
+
+	vector<Mat> foregrounds = drawPoints(cameras, points);
+	for (size_t c = 0; c < cameras.size(); ++c)
+		cameras[c]->setForegroundImage(foregrounds[c]);
+}
+
+/**
+ * The voxels every camera sees as foreground, straight from the LUT
+ */
+vector<int> TestScene::carve(
+		const Reconstructor &reconstructor, const vector<Camera*> &cameras)
+{
+	vector<int> visible;
+	for (size_t v = 0; v < reconstructor.getVoxelsAmount(); ++v)
+	{
+		size_t c = 0;
+		for (; c < cameras.size(); ++c)
+		{
+			const int pixel = reconstructor.getLut(c)[v];
+			if (pixel < 0 || cameras[c]->getForegroundImage().ptr<uchar>()[pixel] != 255) break;
+		}
+		if (c == cameras.size()) visible.push_back((int) v);
+	}
+	return visible;
+}
+
+} /* namespace nl_uu_science_gmt */
@@ -0,0 +1,35 @@
+/*
+ * TestScene.h
+ *
+ *  Created on: Oct 17, 2026
+ */
+
+#ifndef TESTSCENE_H_
+#define TESTSCENE_H_
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+
+namespace nl_uu_science_gmt
+{
+
+class Camera;
+class Reconstructor;
+
+/*
+ * Synthetic foregrounds on the calibrated cameras of the data directory, people
+ * stand as cylinders on the floor and poles as thin segments, for the tests and benchmarks
+ */
+class TestScene
+{
+public:
+	static std::vector<Camera*> loadCameras(const std::string &);
+	static void setForegrounds(const std::vector<Camera*> &, const std::vector<cv::Point2f> &, bool = false);
+	static void setPoles(const std::vector<Camera*> &, const std::vector<cv::Point3f> &);
+	static std::vector<int> carve(const Reconstructor &, const std::vector<Camera*> &);
+};
+
+} /* namespace nl_uu_science_gmt */
+
+#endif /* TESTSCENE_H_ */
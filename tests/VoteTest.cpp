@@ -0,0 +1,107 @@
+/*
+ * VoteTest.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *
+ * Checks that the vote carve of sparse foregrounds and the word carve give the
+ * same visible voxels as the full carve, on scenes from a single thin pole to a
+ * crowd, with and without a blob that only one camera sees.
+ *
+ * usage: VoteTest [data path]
+ */
+
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/controllers/Camera.h"
+#include "../src/controllers/Reconstructor.h"
+#include "../src/utilities/General.h"
+#include "TestScene.h"
+
+using namespace std;
+using namespace cv;
+using namespace nl_uu_science_gmt;
+
+namespace
+{
+
+bool check(
+		bool condition, const string &what)
+{
+	cout << (condition ? "OK   " : "FAIL ") << what << endl;
+	return condition;
+}
+
+/**
+ * Carve the current foregrounds once through the vote path (density 1 makes every
+ * frame sparse) and once through the word path (density 0), and check both against
+ * the full carve
+ */
+bool checkEngines(
+		Reconstructor &reconstructor, const vector<Camera*> &cameras, const string &scene)
+{
+	const vector<int> reference = TestScene::carve(reconstructor, cameras);
+	bool passed = true;
+
+	const float densities[] = { 1, 0 };
+	const char* engines[] = { "vote", "word" };
+	for (int e = 0; e < 2; ++e)
+	{
+		reconstructor.setVoteDensity(densities[e]);
+		reconstructor.update();
+
+		vector<int> visible = reconstructor.getVisibleVoxels();
+		sort(visible.begin(), visible.end());
+		stringstream what;
+		what << scene << ": the " << engines[e] << " carve matches the full carve (" << visible.size() << " of "
+				<< reference.size() << " voxels)";
+		passed &= check(visible == reference, what.str());
+	}
+
+	return passed;
+}
+
+} /* namespace */
+
+int main(
+		int argc, char** argv)
+{
+	const string data_path = argc > 1 ? argv[1] : "data" + string(PATH_SEP);
+	vector<Camera*> cameras = TestScene::loadCameras(data_path);
+
+	Reconstructor* reconstructor = new Reconstructor(cameras);
+	reconstructor->setIncremental(false);
+	reconstructor->setHierarchical(false);
+	reconstructor->setMaxVelocity(0);       // The word carve mustn't lean on the vote carve's frame
+
+	vector<Point3f> ends;
+	ends.push_back(Point3f(-300, 200, 0));
+	ends.push_back(Point3f(-300, 200, 1800));
+	TestScene::setPoles(cameras, ends);
+	bool passed = checkEngines(*reconstructor, cameras, "A pole");
+
+	vector<Point2f> people(1, Point2f(-600, -300));
+	TestScene::setForegrounds(cameras, people);
+	passed &= checkEngines(*reconstructor, cameras, "A person");
+
+	TestScene::setForegrounds(cameras, people, true);
+	passed &= checkEngines(*reconstructor, cameras, "A person and a blob per camera");
+
+	people.push_back(Point2f(600, 400));
+	people.push_back(Point2f(-900, 1000));
+	people.push_back(Point2f(1100, -800));
+	people.push_back(Point2f(0, 0));
+	TestScene::setForegrounds(cameras, people);
+	passed &= checkEngines(*reconstructor, cameras, "A crowd");
+
+	delete reconstructor;
+	for (size_t c = 0; c < cameras.size(); ++c)
+		delete cameras[c];
+
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}